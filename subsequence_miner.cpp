@@ -2,22 +2,107 @@
 #include <vector>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <map>
+#include <set>
 #include <queue>
 #include <algorithm>
 #include <chrono>
 #include <iomanip>
 #include <sstream>
+#include <fstream>
 #include <memory>
 #include <functional>
 #include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <string_view>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
 #include <limits> // Required for cin.ignore
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 using namespace std;
 using namespace std::chrono;
 
-// Forward declaration
-class TrieNode;
+// Compact integer ID for an interned event token
+using TokenId = uint32_t;
+
+// Symbol table that interns each distinct token once
+class SymbolTable {
+private:
+    deque<string> symbols;  // deque keeps the string_view keys below stable
+    unordered_map<string_view, TokenId> ids;
+    
+public:
+    TokenId intern(string_view token) {
+        auto it = ids.find(token);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        
+        TokenId id = static_cast<TokenId>(symbols.size());
+        symbols.emplace_back(token);
+        ids.emplace(symbols.back(), id);
+        return id;
+    }
+    
+    vector<TokenId> encode(const vector<string>& tokens) {
+        vector<TokenId> encoded;
+        encoded.reserve(tokens.size());
+        for (const string& token : tokens) {
+            encoded.push_back(intern(token));
+        }
+        return encoded;
+    }
+    
+    // Returns true and sets id if the token is known; never inserts
+    bool find(string_view token, TokenId& id) const {
+        auto it = ids.find(token);
+        if (it == ids.end()) return false;
+        id = it->second;
+        return true;
+    }
+    
+    const string& decode(TokenId id) const { return symbols[id]; }
+    
+    vector<string> decode(const vector<TokenId>& encoded) const {
+        vector<string> tokens;
+        tokens.reserve(encoded.size());
+        for (TokenId id : encoded) {
+            tokens.push_back(symbols[id]);
+        }
+        return tokens;
+    }
+    
+    size_t size() const { return symbols.size(); }
+    
+    // Approximate heap bytes: each symbol's string plus its hash entry
+    size_t memory_bytes() const {
+        size_t bytes = ids.bucket_count() * sizeof(void*);
+        for (const string& symbol : symbols) {
+            bytes += sizeof(string) + symbol.capacity() + sizeof(pair<string_view, TokenId>) + 2 * sizeof(void*);
+        }
+        return bytes;
+    }
+};
 
 // Structure to hold position information
 struct Position {
@@ -62,543 +147,6865 @@ struct PatternInfo {
     }
 };
 
-// Trie Node class
-class TrieNode {
-public:
-    unordered_map<string, shared_ptr<TrieNode>> children;
-    bool is_end_of_pattern;
+// Index of a node in the trie's node arena
+using NodeIndex = uint32_t;
+const NodeIndex INVALID_NODE = numeric_limits<NodeIndex>::max();
+
+// Trie node stored by value in a contiguous arena; links are 32-bit indices
+struct TrieNode {
+    NodeIndex parent;         // non-owning back link
+    uint32_t edge_begin;      // offset of this node's child slot in the edge pool
+    uint32_t edge_count;
+    uint32_t edge_capacity;
     int frequency;
-    vector<Position> positions;
-    shared_ptr<TrieNode> parent;
-    string character;
-    bool is_noncontiguous;
+    int noncontiguous_frequency;  // share of frequency inserted as non-contiguous
+    int subtree_max_frequency;    // max frequency in this subtree, for query pruning
+    uint32_t postings;            // posting list of occurrences, if positions are tracked
+    TokenId token;
+    bool is_end_of_pattern;
     
-    TrieNode() : is_end_of_pattern(false), frequency(0), parent(nullptr), 
-                 character(""), is_noncontiguous(false) {}
+    TrieNode(NodeIndex p, TokenId t)
+        : parent(p), edge_begin(0), edge_count(0), edge_capacity(0), frequency(0), 
+          noncontiguous_frequency(0), subtree_max_frequency(0), 
+          postings(numeric_limits<uint32_t>::max()), token(t), is_end_of_pattern(false) {}
     
-    void add_position(int sequence_id, int position) {
-        positions.emplace_back(sequence_id, position);
-    }
+    // Counted per insertion so that removing a sequence can undo it exactly
+    bool is_noncontiguous() const { return noncontiguous_frequency > 0; }
 };
 
-// Subsequence Trie class
-class SubsequenceTrie {
+// Child link; each node's edges are kept sorted by token
+struct TrieEdge {
+    TokenId token;
+    NodeIndex child;
+};
+
+// Compressed occurrence lists, one per pattern. Occurrences are grouped by
+// sequence: a group starts with the zigzag delta of its sequence id and the
+// absolute start position, then each further occurrence stores the zigzag
+// delta of its position, all as varints. Bytes live in linked 32-byte blocks
+// from a shared pool, so a list costs a few bytes per occurrence.
+class PostingStore {
+public:
+    static constexpr uint32_t NO_LIST = numeric_limits<uint32_t>::max();
+    
 private:
-    shared_ptr<TrieNode> root;
-    int pattern_count;
+    static constexpr uint32_t NO_BLOCK = numeric_limits<uint32_t>::max();
+    static constexpr size_t BLOCK_PAYLOAD = 28;
     
-public:
-    SubsequenceTrie() : root(make_shared<TrieNode>()), pattern_count(0) {}
+    struct Block {
+        uint8_t bytes[BLOCK_PAYLOAD];
+        uint32_t next;
+    };
     
-    void insert_pattern(const vector<string>& pattern, int sequence_id, 
-                       int start_pos, bool is_noncontiguous = false) {
-        auto node = root;
-        
-        for (size_t i = 0; i < pattern.size(); ++i) {
-            const string& ch = pattern[i];
-            
-            if (node->children.find(ch) == node->children.end()) {
-                node->children[ch] = make_shared<TrieNode>();
-                node->children[ch]->parent = node;
-                node->children[ch]->character = ch;
+    struct List {
+        uint32_t head_block;
+        uint32_t tail_block;
+        uint32_t tail_used;
+        uint32_t count;
+        int last_sequence;
+        int last_position;
+    };
+    
+    vector<Block> blocks;
+    vector<uint32_t> free_blocks;
+    vector<List> lists;
+    vector<uint32_t> free_lists;
+    
+    static uint64_t zigzag(int64_t value) {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+    
+    static int64_t unzigzag(uint64_t value) {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+    
+    uint32_t allocate_block() {
+        uint32_t block;
+        if (!free_blocks.empty()) {
+            block = free_blocks.back();
+            free_blocks.pop_back();
+        } else {
+            block = static_cast<uint32_t>(blocks.size());
+            blocks.emplace_back();
+        }
+        blocks[block].next = NO_BLOCK;
+        return block;
+    }
+    
+    void put_byte(List& list, uint8_t byte) {
+        if (list.tail_block == NO_BLOCK || list.tail_used == BLOCK_PAYLOAD) {
+            uint32_t block = allocate_block();
+            if (list.tail_block == NO_BLOCK) {
+                list.head_block = block;
+            } else {
+                blocks[list.tail_block].next = block;
             }
-            
-            node = node->children[ch];
-            node->add_position(sequence_id, start_pos + static_cast<int>(i));
+            list.tail_block = block;
+            list.tail_used = 0;
         }
-        
-        if (!node->is_end_of_pattern) {
-            node->is_end_of_pattern = true;
-            pattern_count++;
+        blocks[list.tail_block].bytes[list.tail_used++] = byte;
+    }
+    
+    void put_varint(List& list, uint64_t value) {
+        while (value >= 0x80) {
+            put_byte(list, static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
         }
-        
-        node->frequency++;
-        node->is_noncontiguous = is_noncontiguous;
+        put_byte(list, static_cast<uint8_t>(value));
+    }
+    
+    void release_blocks(List& list) {
+        for (uint32_t block = list.head_block; block != NO_BLOCK; block = blocks[block].next) {
+            free_blocks.push_back(block);
+        }
+        list = List{NO_BLOCK, NO_BLOCK, 0, 0, 0, 0};
+    }
+    
+public:
+    uint32_t create() {
+        uint32_t id;
+        if (!free_lists.empty()) {
+            id = free_lists.back();
+            free_lists.pop_back();
+        } else {
+            id = static_cast<uint32_t>(lists.size());
+            lists.emplace_back();
+        }
+        lists[id] = List{NO_BLOCK, NO_BLOCK, 0, 0, 0, 0};
+        return id;
+    }
+    
+    void append(uint32_t id, int sequence_id, int position) {
+        // Reference the list by index: growing blocks never moves lists
+        List& list = lists[id];
+        if (list.count == 0 || sequence_id != list.last_sequence) {
+            put_varint(list, (zigzag(static_cast<int64_t>(sequence_id) - list.last_sequence) << 1) | 1);
+            put_varint(list, static_cast<uint64_t>(position));
+        } else {
+            put_varint(list, zigzag(static_cast<int64_t>(position) - list.last_position) << 1);
+        }
+        list.last_sequence = sequence_id;
+        list.last_position = position;
+        list.count++;
     }
     
-    shared_ptr<TrieNode> search_pattern(const vector<string>& pattern) {
-        auto node = root;
+    // Decodes count entries from a byte source; shared with mapped snapshots,
+    // which store each list's bytes contiguously
+    template <typename ByteSource, typename Visitor>
+    static void decode_entries(ByteSource next_byte, uint32_t count, Visitor visit) {
+        auto next_varint = [&]() {
+            uint64_t value = 0;
+            for (int shift = 0;; shift += 7) {
+                uint8_t byte = next_byte();
+                value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) return value;
+            }
+        };
         
-        for (const string& ch : pattern) {
-            if (node->children.find(ch) == node->children.end()) {
-                return nullptr;
+        int64_t sequence_id = 0, position = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            uint64_t header = next_varint();
+            if (header & 1) {
+                sequence_id += unzigzag(header >> 1);
+                position = static_cast<int64_t>(next_varint());
+            } else {
+                position += unzigzag(header >> 1);
             }
-            node = node->children[ch];
+            visit(static_cast<int>(sequence_id), static_cast<int>(position));
         }
-        
-        return node->is_end_of_pattern ? node : nullptr;
     }
     
-    vector<tuple<vector<string>, int, bool>> get_frequent_patterns(int min_frequency, 
-                                                                   bool noncontiguous_only = false) {
-        vector<tuple<vector<string>, int, bool>> patterns;
-        vector<string> current_pattern;
-        
-        function<void(shared_ptr<TrieNode>)> dfs = [&](shared_ptr<TrieNode> node) {
-            if (node->is_end_of_pattern && node->frequency >= min_frequency) {
-                if (!noncontiguous_only || node->is_noncontiguous) {
-                    patterns.emplace_back(current_pattern, node->frequency, node->is_noncontiguous);
-                }
+    template <typename Visitor>
+    void for_each(uint32_t id, Visitor visit) const {
+        const List& list = lists[id];
+        uint32_t block = list.head_block;
+        size_t offset = 0;
+        decode_entries([&]() {
+            if (offset == BLOCK_PAYLOAD) {
+                block = blocks[block].next;
+                offset = 0;
             }
+            return blocks[block].bytes[offset++];
+        }, list.count, visit);
+    }
+    
+    // Appends the list's encoded bytes, which decode_entries reads back
+    void copy_bytes(uint32_t id, vector<uint8_t>& out) const {
+        const List& list = lists[id];
+        for (uint32_t block = list.head_block; block != NO_BLOCK; block = blocks[block].next) {
+            size_t used = block == list.tail_block ? list.tail_used : BLOCK_PAYLOAD;
+            out.insert(out.end(), blocks[block].bytes, blocks[block].bytes + used);
+        }
+    }
+    
+    vector<Position> decode(uint32_t id) const {
+        vector<Position> positions;
+        positions.reserve(lists[id].count);
+        for_each(id, [&](int sequence_id, int position) { positions.emplace_back(sequence_id, position); });
+        return positions;
+    }
+    
+    // Re-encodes the list without the given sequences
+    void remove_sequences(uint32_t id, const unordered_set<int>& sequence_ids) {
+        vector<Position> kept;
+        for_each(id, [&](int sequence_id, int position) {
+            if (!sequence_ids.count(sequence_id)) kept.emplace_back(sequence_id, position);
+        });
+        release_blocks(lists[id]);
+        for (const Position& p : kept) append(id, p.sequence_id, p.position);
+    }
+    
+    void release(uint32_t id) {
+        release_blocks(lists[id]);
+        free_lists.push_back(id);
+    }
+    
+    uint32_t count(uint32_t id) const { return lists[id].count; }
+    
+    size_t memory_bytes() const {
+        return blocks.capacity() * sizeof(Block) + lists.capacity() * sizeof(List) + 
+               (free_blocks.capacity() + free_lists.capacity()) * sizeof(uint32_t);
+    }
+};
+
+// A mined pattern as (tokens, frequency, is_noncontiguous)
+using PatternCount = tuple<vector<TokenId>, int, bool>;
+
+// Which frequent patterns a query reports. A pattern is compared with the
+// patterns one token longer (a token inserted anywhere); with per-sequence
+// support that is the same as comparing with every super-pattern. Patterns
+// are capped at max_length, so a frequent max_length pattern always qualifies.
+enum class PatternClosure {
+    All,      // every frequent pattern
+    Closed,   // no one-token-longer pattern is at least as frequent
+    Maximal   // no one-token-longer pattern is frequent
+};
+
+const char* closure_name(PatternClosure closure) {
+    switch (closure) {
+        case PatternClosure::All: return "all";
+        case PatternClosure::Closed: return "closed";
+        case PatternClosure::Maximal: return "maximal";
+    }
+    return "unknown";
+}
+
+bool parse_closure_name(const string& name, PatternClosure& closure) {
+    for (PatternClosure candidate : {PatternClosure::All, PatternClosure::Closed, PatternClosure::Maximal}) {
+        if (name == closure_name(candidate)) {
+            closure = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Drops the patterns that a one-token-longer pattern of the same result set
+// absorbs, keeping the order of the rest. For engines that only produce whole
+// result sets; with contiguous_only the longer pattern adds its token at an end.
+void filter_by_closure(vector<PatternCount>& patterns, PatternClosure closure, bool contiguous_only) {
+    if (closure == PatternClosure::All) return;
+    
+    vector<size_t> by_tokens(patterns.size());
+    for (size_t i = 0; i < by_tokens.size(); ++i) by_tokens[i] = i;
+    sort(by_tokens.begin(), by_tokens.end(), [&](size_t a, size_t b) {
+        return get<0>(patterns[a]) < get<0>(patterns[b]);
+    });
+    
+    vector<bool> absorbed(patterns.size(), false);
+    vector<TokenId> shorter;
+    for (const PatternCount& longer : patterns) {
+        const vector<TokenId>& tokens = get<0>(longer);
+        for (size_t j = 0; tokens.size() > 1 && j < tokens.size(); ++j) {
+            if (contiguous_only && j != 0 && j + 1 != tokens.size()) continue;
             
-            for (const auto& child_pair : node->children) {
-                const string& ch = child_pair.first;
-                shared_ptr<TrieNode> child = child_pair.second;
-                current_pattern.push_back(ch);
-                dfs(child);
-                current_pattern.pop_back();
+            shorter.assign(tokens.begin(), tokens.end());
+            shorter.erase(shorter.begin() + j);
+            auto it = lower_bound(by_tokens.begin(), by_tokens.end(), shorter, 
+                                  [&](size_t i, const vector<TokenId>& key) { return get<0>(patterns[i]) < key; });
+            if (it == by_tokens.end() || get<0>(patterns[*it]) != shorter) continue;
+            if (closure == PatternClosure::Maximal || get<1>(longer) >= get<1>(patterns[*it])) {
+                absorbed[*it] = true;
             }
-        };
-        
-        dfs(root);
+        }
+    }
+    
+    size_t kept = 0;
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        if (absorbed[i]) continue;
+        if (kept != i) patterns[kept] = move(patterns[i]);
+        kept++;
+    }
+    patterns.resize(kept);
+}
+
+// Milliseconds since start
+inline double elapsed_ms(high_resolution_clock::time_point start, 
+                         high_resolution_clock::time_point end = high_resolution_clock::now()) {
+    return duration_cast<nanoseconds>(end - start).count() / 1e6;
+}
+
+// What an engine did for one query, filled in when the caller passes one
+struct QueryProfile {
+    long long candidates = 0;  // patterns whose support was checked against the threshold
+    double sort_time = 0.0;    // ms ordering a full result (top-k heaps order as they go)
+};
+
+// Keeps the k best patterns seen so far in a heap with the worst on top.
+// Patterns rank by frequency (descending) and then token order. Once the heap
+// is full the worst frequency becomes the effective support threshold, so a
+// traversal can drop any branch whose frequency bound falls below it, and
+// token vectors are only copied for patterns that enter the heap.
+class TopKCollector {
+private:
+    size_t capacity;
+    int min_support;
+    vector<PatternCount> heap;
+    
+    static bool ranks_before(int frequency, const TokenId* tokens, size_t length, 
+                             const PatternCount& other) {
+        if (frequency != get<1>(other)) return frequency > get<1>(other);
+        const vector<TokenId>& other_tokens = get<0>(other);
+        return lexicographical_compare(tokens, tokens + length, 
+                                       other_tokens.begin(), other_tokens.end());
+    }
+    
+    static bool rank_order(const PatternCount& a, const PatternCount& b) {
+        return ranks_before(get<1>(a), get<0>(a).data(), get<0>(a).size(), b);
+    }
+    
+public:
+    TopKCollector(size_t k, int min_sup) : capacity(k), min_support(max(min_sup, 1)) {
+        heap.reserve(k);
+    }
+    
+    // Smallest frequency that can still enter; bounds below it can be pruned
+    int threshold() const {
+        if (capacity == 0) return numeric_limits<int>::max();  // nothing can enter
+        if (heap.size() < capacity) return min_support;
+        return max(min_support, get<1>(heap.front()));
+    }
+    
+    bool offer(const TokenId* tokens, size_t length, int frequency, bool is_noncontiguous) {
+        if (capacity == 0 || frequency < min_support) return false;
         
-        // Sort by frequency (descending)
-        sort(patterns.begin(), patterns.end(), 
-             [](const auto& a, const auto& b) {
-                 return get<1>(a) > get<1>(b);
-             });
+        if (heap.size() == capacity) {
+            if (!ranks_before(frequency, tokens, length, heap.front())) return false;
+            pop_heap(heap.begin(), heap.end(), rank_order);
+            heap.pop_back();
+        }
         
-        return patterns;
+        heap.emplace_back(vector<TokenId>(tokens, tokens + length), frequency, is_noncontiguous);
+        push_heap(heap.begin(), heap.end(), rank_order);
+        return true;
     }
     
-    int get_pattern_count() const { return pattern_count; }
+    bool offer(const vector<TokenId>& tokens, int frequency, bool is_noncontiguous) {
+        return offer(tokens.data(), tokens.size(), frequency, is_noncontiguous);
+    }
+    
+    // Best first; leaves the collector empty
+    vector<PatternCount> take_sorted() {
+        sort(heap.begin(), heap.end(), rank_order);
+        return move(heap);
+    }
 };
 
-// Sequence data structure
-struct SequenceData {
-    int id;
-    vector<string> sequence;
-    int length;
-    
-    SequenceData(int i, const vector<string>& seq) 
-        : id(i), sequence(seq), length(static_cast<int>(seq.size())) {}
+// On-disk index snapshot, laid out to be memory-mapped and read in place.
+// A header is followed by 8-byte aligned sections: trie nodes in arena order
+// (parents before children), their edges packed per node, posting bytes,
+// the symbol table (offsets, text, ids sorted by text for lookup) and the
+// sequences in arrival order. All integers are native-endian.
+constexpr char SNAPSHOT_MAGIC[8] = {'S', 'S', 'M', 'I', 'N', 'D', 'E', 'X'};
+constexpr uint32_t SNAPSHOT_VERSION = 2;  // 2 added the gap constraints
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t format_version;
+    uint32_t header_bytes;      // sizeof(SnapshotHeader) at write time
+    int32_t min_length;
+    int32_t max_length;
+    uint32_t track_positions;
+    int32_t next_sequence_id;
+    int32_t min_gap;
+    int32_t max_gap;            // negative: no limit
+    int32_t max_window;         // negative: no limit
+    uint32_t reserved;
+    uint64_t node_count;
+    uint64_t edge_count;
+    uint64_t posting_bytes;
+    uint64_t symbol_count;
+    uint64_t symbol_bytes;
+    uint64_t sequence_count;
+    uint64_t token_count;
+    uint64_t nodes_offset;
+    uint64_t edges_offset;
+    uint64_t postings_offset;
+    uint64_t symbol_offsets_offset;  // symbol_count + 1 uint64 offsets into the text
+    uint64_t symbol_text_offset;
+    uint64_t symbol_order_offset;    // TokenIds sorted by symbol text
+    uint64_t sequence_ids_offset;
+    uint64_t sequence_offsets_offset;  // sequence_count + 1 uint64 offsets into tokens
+    uint64_t sequence_tokens_offset;
+    uint64_t file_bytes;
 };
 
-// Mining statistics
-struct MiningStatistics {
-    int total_sequences;
-    int total_patterns_found;
-    double mining_time;
-    int cache_hits;
+struct SnapshotNode {
+    uint32_t edge_begin;
+    uint32_t edge_count;
+    int32_t frequency;
+    int32_t noncontiguous_frequency;
+    int32_t subtree_max_frequency;
+    TokenId token;
+    uint32_t is_end_of_pattern;
+    uint32_t posting_count;
+    uint64_t posting_offset;
+};
+
+static_assert(sizeof(SnapshotHeader) == 184, "snapshot header layout changed");
+static_assert(sizeof(SnapshotNode) == 40, "snapshot node layout changed");
+static_assert(sizeof(TrieEdge) == 8, "snapshot edge layout changed");
+
+// Memory usage of the trie, with an estimate for the old shared_ptr layout
+struct TrieMemoryReport {
+    size_t node_count;
+    size_t edge_count;
+    size_t node_bytes;
+    size_t edge_bytes;
+    size_t position_bytes;
+    double bytes_per_node;
+    double legacy_bytes_per_node;
     
-    MiningStatistics() : total_sequences(0), total_patterns_found(0), 
-                        mining_time(0.0), cache_hits(0) {}
+    TrieMemoryReport() : node_count(0), edge_count(0), node_bytes(0), edge_bytes(0), 
+                        position_bytes(0), bytes_per_node(0.0), legacy_bytes_per_node(0.0) {}
 };
 
-// Main Advanced Subsequence Miner class
-class AdvancedSubsequenceMiner {
+// Subsequence Trie class
+class SubsequenceTrie {
 private:
-    int min_length;
-    int max_length;
-    SubsequenceTrie trie;
-    vector<SequenceData> sequence_database;
-    unordered_map<string, PatternInfo> pattern_cache;
-    MiningStatistics statistics;
+    static const NodeIndex ROOT = 0;
+    
+    vector<TrieNode> nodes;
+    vector<TrieEdge> edges;
+    vector<vector<uint32_t>> free_slots;  // released edge slots, by log2(capacity)
+    PostingStore postings;
+    vector<NodeIndex> postings_to_clean;  // lists that may hold removed sequences
+    bool track_positions;
+    int pattern_count;
+    
+    static size_t capacity_class(uint32_t capacity) {
+        size_t cls = 0;
+        while ((1u << cls) < capacity) ++cls;
+        return cls;
+    }
     
-    void generate_subsequences(const vector<string>& sequence, int seq_id) {
-        int sequence_len = static_cast<int>(sequence.size());
+    uint32_t allocate_slot(uint32_t capacity) {
+        size_t cls = capacity_class(capacity);
+        if (cls < free_slots.size() && !free_slots[cls].empty()) {
+            uint32_t slot = free_slots[cls].back();
+            free_slots[cls].pop_back();
+            return slot;
+        }
         
-        // Generate contiguous subsequences
-        for (int length = min_length; length <= min(max_length, sequence_len); ++length) {
-            for (int start = 0; start <= sequence_len - length; ++start) {
-                vector<string> subsequence(sequence.begin() + start, 
-                                         sequence.begin() + start + length);
-                trie.insert_pattern(subsequence, seq_id, start, false);
-            }
+        uint32_t slot = static_cast<uint32_t>(edges.size());
+        edges.resize(edges.size() + capacity);
+        return slot;
+    }
+    
+    void release_slot(uint32_t slot, uint32_t capacity) {
+        size_t cls = capacity_class(capacity);
+        if (free_slots.size() <= cls) free_slots.resize(cls + 1);
+        free_slots[cls].push_back(slot);
+    }
+    
+    NodeIndex find_child(NodeIndex node, TokenId token) const {
+        const TrieNode& n = nodes[node];
+        auto first = edges.begin() + n.edge_begin;
+        auto last = first + n.edge_count;
+        auto it = lower_bound(first, last, token, 
+                              [](const TrieEdge& e, TokenId t) { return e.token < t; });
+        return (it != last && it->token == token) ? it->child : INVALID_NODE;
+    }
+    
+    NodeIndex find_or_add_child(NodeIndex node, TokenId token) {
+        uint32_t begin = nodes[node].edge_begin;
+        uint32_t count = nodes[node].edge_count;
+        auto first = edges.begin() + begin;
+        auto it = lower_bound(first, first + count, token, 
+                              [](const TrieEdge& e, TokenId t) { return e.token < t; });
+        size_t offset = static_cast<size_t>(it - first);
+        if (offset < count && it->token == token) {
+            return it->child;
         }
         
-        // Generate non-contiguous subsequences (limited for performance)
-        if (sequence_len <= 20) {  // Only for smaller sequences
-            generate_noncontiguous_subsequences(sequence, seq_id);
+        NodeIndex child = static_cast<NodeIndex>(nodes.size());
+        nodes.emplace_back(node, token);
+        
+        // Grow the slot by doubling; the old slot is recycled for other nodes
+        if (count == nodes[node].edge_capacity) {
+            uint32_t capacity = count == 0 ? 2 : count * 2;
+            uint32_t slot = allocate_slot(capacity);
+            copy(edges.begin() + begin, edges.begin() + begin + count, edges.begin() + slot);
+            if (nodes[node].edge_capacity > 0) {
+                release_slot(begin, nodes[node].edge_capacity);
+            }
+            nodes[node].edge_begin = begin = slot;
+            nodes[node].edge_capacity = capacity;
         }
+        
+        first = edges.begin() + begin;
+        copy_backward(first + offset, first + count, first + count + 1);
+        first[offset] = TrieEdge{token, child};
+        nodes[node].edge_count = count + 1;
+        return child;
     }
     
-    void generate_noncontiguous_subsequences(const vector<string>& sequence, int seq_id) {
-        int n = static_cast<int>(sequence.size());
-        int max_combinations = min(1000, 1 << n);
-        
-        for (int i = 1; i < max_combinations; ++i) {
-            vector<string> subsequence;
-            vector<int> positions;
-            
-            for (int j = 0; j < n; ++j) {
-                if (i & (1 << j)) {
-                    subsequence.push_back(sequence[j]);
-                    positions.push_back(j);
+    // Raises extension[] for every pattern that a frequent pattern in node's
+    // subtree contains with one token deleted. path holds the nodes from the
+    // root to node, so deleting token j resumes from the depth-j ancestor.
+    void mark_extensions(NodeIndex node, int min_frequency, vector<NodeIndex>& path, 
+                         vector<TokenId>& tokens, vector<int>& extension) const {
+        const TrieNode& n = nodes[node];
+        if (n.is_end_of_pattern && n.frequency >= min_frequency && tokens.size() > 1) {
+            for (size_t j = 0; j < tokens.size(); ++j) {
+                NodeIndex shorter = path[j];
+                for (size_t d = j + 1; d < tokens.size() && shorter != INVALID_NODE; ++d) {
+                    shorter = find_child(shorter, tokens[d]);
                 }
+                if (shorter != INVALID_NODE) extension[shorter] = max(extension[shorter], n.frequency);
             }
-            
-            if (static_cast<int>(subsequence.size()) >= min_length && 
-                static_cast<int>(subsequence.size()) <= max_length) {
-                trie.insert_pattern(subsequence, seq_id, positions.empty() ? 0 : positions[0], true);
-            }
+        }
+        
+        for (uint32_t i = 0; i < n.edge_count; ++i) {
+            const TrieEdge& edge = edges[n.edge_begin + i];
+            if (nodes[edge.child].subtree_max_frequency < min_frequency) continue;
+            path.push_back(edge.child);
+            tokens.push_back(edge.token);
+            mark_extensions(edge.child, min_frequency, path, tokens, extension);
+            tokens.pop_back();
+            path.pop_back();
         }
     }
     
-    string join_pattern(const vector<string>& pattern, const string& delimiter = " -> ") {
-        if (pattern.empty()) return "";
+    // For closed and maximal queries: per node, the highest frequency among the
+    // indexed patterns one token longer that contain it, counting only those of
+    // at least min_frequency. One pass over the frequent patterns replaces a
+    // search of every ancestor's children for each reported pattern.
+    vector<int> closure_extensions(PatternClosure closure, int min_frequency) const {
+        vector<int> extension;
+        if (closure == PatternClosure::All) return extension;
+        extension.assign(nodes.size(), 0);
+        vector<NodeIndex> path = {ROOT};
+        vector<TokenId> tokens;
+        mark_extensions(ROOT, min_frequency, path, tokens, extension);
+        return extension;
+    }
+    
+    // Calls emit(tokens, frequency, is_noncontiguous) for each reported pattern in
+    // token order, pruning by top_k's threshold when given. Closure is decided
+    // here from closure_extensions, before a pattern is copied out.
+    template <typename Emit>
+    void collect_patterns(NodeIndex node, int min_frequency, bool noncontiguous_only, 
+                          PatternClosure closure, const vector<int>& extension, 
+                          vector<TokenId>& current_pattern, const TopKCollector* top_k, 
+                          QueryProfile* profile, Emit& emit) const {
+        const TrieNode& n = nodes[node];
+        if (profile && n.is_end_of_pattern) profile->candidates++;
+        if (n.is_end_of_pattern && n.frequency >= min_frequency && 
+            (!top_k || n.frequency >= top_k->threshold())) {
+            bool reported = !noncontiguous_only || n.is_noncontiguous();
+            if (reported && closure != PatternClosure::All) {
+                int needed = closure == PatternClosure::Closed ? n.frequency : min_frequency;
+                reported = extension[node] < needed;
+            }
+            if (reported) emit(current_pattern, n.frequency, n.is_noncontiguous());
+        }
         
-        ostringstream oss;
-        for (size_t i = 0; i < pattern.size(); ++i) {
-            if (i > 0) oss << delimiter;
-            oss << pattern[i];
+        for (uint32_t i = 0; i < n.edge_count; ++i) {
+            const TrieEdge& edge = edges[n.edge_begin + i];
+            // Skip subtrees that cannot contain a frequent pattern
+            int threshold = top_k ? top_k->threshold() : min_frequency;
+            if (nodes[edge.child].subtree_max_frequency < threshold) continue;
+            current_pattern.push_back(edge.token);
+            collect_patterns(edge.child, min_frequency, noncontiguous_only, closure, extension, 
+                             current_pattern, top_k, profile, emit);
+            current_pattern.pop_back();
         }
-        return oss.str();
     }
     
 public:
-    AdvancedSubsequenceMiner(int min_len = 2, int max_len = 10) 
-        : min_length(min_len), max_length(max_len) {}
+    // Without position tracking only counts are kept and get_positions is empty
+    explicit SubsequenceTrie(bool positions = true) : track_positions(positions), pattern_count(0) {
+        nodes.emplace_back(INVALID_NODE, 0);
+    }
     
-    int add_sequence(const vector<string>& sequence, int sequence_id = -1) {
-        if (sequence_id == -1) {
-            sequence_id = static_cast<int>(sequence_database.size());
-        }
-        
-        sequence_database.emplace_back(sequence_id, sequence);
-        statistics.total_sequences++;
-        
-        return sequence_id;
+    void insert_pattern(const vector<TokenId>& pattern, int sequence_id, 
+                       int start_pos, bool is_noncontiguous = false, int weight = 1) {
+        insert_pattern(pattern.data(), pattern.size(), sequence_id, start_pos, is_noncontiguous, weight);
     }
     
-    vector<PatternInfo> mine_frequent_patterns(int min_support = 2, bool noncontiguous_only = false) {
-        auto start_time = high_resolution_clock::now();
+    // Inserts pattern[0..length) without requiring the caller to copy it out.
+    // weight counts the occurrence as that many sequences; a negative sequence_id
+    // adds counts only, for further copies of a sequence whose positions are indexed.
+    void insert_pattern(const TokenId* pattern, size_t length, int sequence_id, 
+                       int start_pos, bool is_noncontiguous = false, int weight = 1) {
+        NodeIndex node = ROOT;
         
-        // Generate all subsequences
-        for (const auto& seq_data : sequence_database) {
-            generate_subsequences(seq_data.sequence, seq_data.id);
+        for (size_t i = 0; i < length; ++i) {
+            node = find_or_add_child(node, pattern[i]);
         }
         
-        // Extract frequent patterns
-        auto frequent_patterns = trie.get_frequent_patterns(min_support, noncontiguous_only);
-        
-        // Convert to PatternInfo objects
-        vector<PatternInfo> enhanced_patterns;
-        for (const auto& pattern_tuple : frequent_patterns) {
-            const vector<string>& pattern = get<0>(pattern_tuple);
-            int frequency = get<1>(pattern_tuple);
-            bool is_noncontiguous = get<2>(pattern_tuple);
-            
-            double support = sequence_database.empty() ? 0.0 : 
-                           static_cast<double>(frequency) / sequence_database.size();
-            
-            string pattern_string = join_pattern(pattern);
-            string pattern_type = is_noncontiguous ? "Non-contiguous" : "Contiguous";
-            
-            enhanced_patterns.emplace_back(pattern, frequency, static_cast<int>(pattern.size()), 
-                                         support, pattern_string, is_noncontiguous, pattern_type);
+        TrieNode& end = nodes[node];
+        if (!end.is_end_of_pattern) {
+            end.is_end_of_pattern = true;
+            pattern_count++;
         }
         
-        auto end_time = high_resolution_clock::now();
-        statistics.mining_time = duration_cast<microseconds>(end_time - start_time).count() / 1000.0;
-        statistics.total_patterns_found = static_cast<int>(enhanced_patterns.size());
-        
-        return enhanced_patterns;
-    }
-    
-    vector<PatternInfo> find_top_k_patterns(int k = 10, int min_support = 2, 
-                                           bool noncontiguous_only = false) {
-        auto patterns = mine_frequent_patterns(min_support, noncontiguous_only);
+        end.frequency += weight;
+        if (is_noncontiguous) end.noncontiguous_frequency += weight;
         
-        if (static_cast<int>(patterns.size()) <= k) {
-            return patterns;
+        // One entry per occurrence, at the pattern's end node only
+        if (track_positions && sequence_id >= 0) {
+            if (end.postings == PostingStore::NO_LIST) end.postings = postings.create();
+            postings.append(end.postings, sequence_id, start_pos);
         }
         
-        // Sort by frequency (descending) and take top k
-        sort(patterns.begin(), patterns.end(), 
-             [](const PatternInfo& a, const PatternInfo& b) {
-                 return a.frequency > b.frequency;
-             });
-        
-        patterns.resize(k);
-        return patterns;
+        // Ancestors only need raising until one already covers the new count
+        int frequency = end.frequency;
+        for (NodeIndex n = node; n != ROOT && nodes[n].subtree_max_frequency < frequency; 
+             n = nodes[n].parent) {
+            nodes[n].subtree_max_frequency = frequency;
+        }
     }
     
-    map<string, int> analyze_pattern_distribution() {
-        auto patterns = mine_frequent_patterns(1);
-        
-        map<string, int> length_distribution;
-        map<string, int> frequency_distribution;
+    // Undoes earlier insert_pattern calls for the same pattern and type, weight copies' worth
+    void remove_pattern(const TokenId* pattern, size_t length, bool is_noncontiguous = false, 
+                        int weight = 1) {
+        NodeIndex node = ROOT;
         
-        for (const auto& pattern : patterns) {
-            length_distribution["length_" + to_string(pattern.length)]++;
-            frequency_distribution["freq_" + to_string(pattern.frequency)]++;
+        for (size_t i = 0; i < length; ++i) {
+            node = find_child(node, pattern[i]);
+            if (node == INVALID_NODE) return;
         }
         
-        map<string, int> result;
-        result["total_unique_patterns"] = static_cast<int>(patterns.size());
+        TrieNode& end = nodes[node];
+        if (!end.is_end_of_pattern || end.frequency == 0) return;
         
-        // Add distributions
-        for (const auto& dist_pair : length_distribution) {
-            result[dist_pair.first] = dist_pair.second;
+        end.frequency = max(end.frequency - weight, 0);
+        if (is_noncontiguous) end.noncontiguous_frequency = max(end.noncontiguous_frequency - weight, 0);
+        if (end.frequency == 0) {
+            end.is_end_of_pattern = false;
+            pattern_count--;
+        }
+        if (end.postings != PostingStore::NO_LIST) {
+            postings_to_clean.push_back(node);
         }
         
-        return result;
+        // Recompute subtree maxima upwards until one is unaffected
+        for (NodeIndex n = node; n != ROOT; n = nodes[n].parent) {
+            const TrieNode& current = nodes[n];
+            int subtree_max = current.frequency;
+            for (uint32_t i = 0; i < current.edge_count; ++i) {
+                subtree_max = max(subtree_max, 
+                                  nodes[edges[current.edge_begin + i].child].subtree_max_frequency);
+            }
+            if (subtree_max == current.subtree_max_frequency) break;
+            nodes[n].subtree_max_frequency = subtree_max;
+        }
     }
     
-    MiningStatistics get_mining_statistics() {
-        statistics.cache_hits = 0; // Placeholder
-        return statistics;
+    // Drops positions of the given sequences from the lists remove_pattern touched
+    void remove_positions(const unordered_set<int>& sequence_ids) {
+        sort(postings_to_clean.begin(), postings_to_clean.end());
+        postings_to_clean.erase(unique(postings_to_clean.begin(), postings_to_clean.end()), 
+                                postings_to_clean.end());
+        
+        for (NodeIndex node : postings_to_clean) {
+            TrieNode& n = nodes[node];
+            if (n.postings == PostingStore::NO_LIST) continue;
+            if (n.frequency == 0) {
+                postings.release(n.postings);
+                n.postings = PostingStore::NO_LIST;
+            } else {
+                postings.remove_sequences(n.postings, sequence_ids);
+            }
+        }
+        postings_to_clean.clear();
     }
     
-    void print_statistics() {
-        cout << "\n=== Mining Statistics ===" << endl;
-        cout << "Total sequences: " << statistics.total_sequences << endl;
-        cout << "Total patterns found: " << statistics.total_patterns_found << endl;
-        cout << "Mining time: " << fixed << setprecision(4) << statistics.mining_time << " ms" << endl;
-        cout << "Trie size: " << trie.get_pattern_count() << endl;
+    // Adds another trie's counts and positions into this one
+    void merge_from(const SubsequenceTrie& other) {
+        vector<NodeIndex> remap(other.nodes.size(), INVALID_NODE);
+        remap[ROOT] = ROOT;
         
-        if (statistics.total_sequences > 0) {
-            double avg_seq_len = 0.0;
-            for (const auto& seq : sequence_database) {
-                avg_seq_len += seq.length;
+        // Nodes are appended after their parent, so index order visits parents first
+        for (NodeIndex n = 1; n < other.nodes.size(); ++n) {
+            const TrieNode& source = other.nodes[n];
+            NodeIndex target = find_or_add_child(remap[source.parent], source.token);
+            remap[n] = target;
+            if (!source.is_end_of_pattern) continue;
+            
+            TrieNode& end = nodes[target];
+            if (!end.is_end_of_pattern) {
+                end.is_end_of_pattern = true;
+                pattern_count++;
+            }
+            end.frequency += source.frequency;
+            end.noncontiguous_frequency += source.noncontiguous_frequency;
+            
+            if (track_positions && source.postings != PostingStore::NO_LIST) {
+                if (end.postings == PostingStore::NO_LIST) end.postings = postings.create();
+                other.postings.for_each(source.postings, [&](int sequence_id, int position) {
+                    postings.append(end.postings, sequence_id, position);
+                });
+            }
+            
+            int frequency = end.frequency;
+            for (NodeIndex a = target; a != ROOT && nodes[a].subtree_max_frequency < frequency; 
+                 a = nodes[a].parent) {
+                nodes[a].subtree_max_frequency = frequency;
             }
-            avg_seq_len /= statistics.total_sequences;
-            cout << "Average sequence length: " << fixed << setprecision(2) << avg_seq_len << endl;
         }
     }
-};
-
-// Utility functions
-vector<string> split_string(const string& str, char delimiter = ' ') {
-    vector<string> tokens;
-    stringstream ss(str);
-    string token;
     
-    while (getline(ss, token, delimiter)) {
-        if (!token.empty()) {
-            tokens.push_back(token);
+    // Returns the pattern's end node, or nullptr; invalidated by later inserts
+    const TrieNode* search_pattern(const vector<TokenId>& pattern) const {
+        NodeIndex node = ROOT;
+        
+        for (TokenId ch : pattern) {
+            node = find_child(node, ch);
+            if (node == INVALID_NODE) {
+                return nullptr;
+            }
         }
+        
+        return nodes[node].is_end_of_pattern ? &nodes[node] : nullptr;
     }
     
-    return tokens;
+    // Looks up many patterns in one pass: patterns are visited in sorted order
+    // and each walk resumes from the prefix it shares with the previous one
+    vector<const TrieNode*> search_patterns(const vector<vector<TokenId>>& patterns) const {
+        vector<size_t> order(patterns.size());
+        for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+        sort(order.begin(), order.end(), [&](size_t a, size_t b) { return patterns[a] < patterns[b]; });
+        
+        vector<const TrieNode*> found(patterns.size(), nullptr);
+        vector<NodeIndex> path = {ROOT};  // nodes reached by the previous walk, by depth
+        const vector<TokenId>* previous = nullptr;
+        
+        for (size_t i : order) {
+            const vector<TokenId>& pattern = patterns[i];
+            size_t common = 0;
+            if (previous) {
+                while (common + 1 < path.size() && common < pattern.size() && 
+                       pattern[common] == (*previous)[common]) {
+                    common++;
+                }
+            }
+            path.resize(common + 1);
+            
+            NodeIndex node = path.back();
+            for (size_t d = common; d < pattern.size(); ++d) {
+                node = find_child(node, pattern[d]);
+                if (node == INVALID_NODE) break;
+                path.push_back(node);
+            }
+            if (node != INVALID_NODE && nodes[node].is_end_of_pattern) found[i] = &nodes[node];
+            previous = &pattern;
+        }
+        return found;
+    }
+    
+    // Occurrences of the pattern as (sequence, start) pairs in insertion order
+    vector<Position> get_positions(const vector<TokenId>& pattern) const {
+        const TrieNode* node = search_pattern(pattern);
+        if (node == nullptr || node->postings == PostingStore::NO_LIST) return {};
+        return postings.decode(node->postings);
+    }
+    
+    bool tracks_positions() const { return track_positions; }
+    
+    // Flat copy for snapshots: same node indices, edges packed with no spare capacity
+    void export_flat(vector<SnapshotNode>& flat_nodes, vector<TrieEdge>& flat_edges, 
+                     vector<uint8_t>& posting_bytes) const {
+        flat_nodes.clear();
+        flat_edges.clear();
+        posting_bytes.clear();
+        flat_nodes.reserve(nodes.size());
+        flat_edges.reserve(nodes.size());
+        
+        for (const TrieNode& n : nodes) {
+            SnapshotNode flat = {};
+            flat.edge_begin = static_cast<uint32_t>(flat_edges.size());
+            flat.edge_count = n.edge_count;
+            flat.frequency = n.frequency;
+            flat.noncontiguous_frequency = n.noncontiguous_frequency;
+            flat.subtree_max_frequency = n.subtree_max_frequency;
+            flat.token = n.token;
+            flat.is_end_of_pattern = n.is_end_of_pattern;
+            flat.posting_offset = posting_bytes.size();
+            if (n.postings != PostingStore::NO_LIST) {
+                flat.posting_count = postings.count(n.postings);
+                postings.copy_bytes(n.postings, posting_bytes);
+            }
+            flat_nodes.push_back(flat);
+            flat_edges.insert(flat_edges.end(), edges.begin() + n.edge_begin, 
+                              edges.begin() + n.edge_begin + n.edge_count);
+        }
+    }
+    
+    // Replaces the trie with a snapshot's flat arrays
+    void import_flat(const SnapshotNode* flat_nodes, size_t node_count, const TrieEdge* flat_edges, 
+                     const uint8_t* posting_bytes) {
+        *this = SubsequenceTrie(track_positions);
+        nodes.clear();
+        nodes.reserve(node_count);
+        
+        for (size_t i = 0; i < node_count; ++i) {
+            const SnapshotNode& flat = flat_nodes[i];
+            nodes.emplace_back(INVALID_NODE, flat.token);
+            TrieNode& n = nodes.back();
+            n.frequency = flat.frequency;
+            n.noncontiguous_frequency = flat.noncontiguous_frequency;
+            n.subtree_max_frequency = flat.subtree_max_frequency;
+            n.is_end_of_pattern = flat.is_end_of_pattern != 0;
+            if (n.is_end_of_pattern) pattern_count++;
+            
+            if (track_positions && flat.posting_count > 0) {
+                n.postings = postings.create();
+                const uint8_t* cursor = posting_bytes + flat.posting_offset;
+                PostingStore::decode_entries([&]() { return *cursor++; }, flat.posting_count, 
+                                             [&](int sequence_id, int position) {
+                    postings.append(n.postings, sequence_id, position);
+                });
+            }
+        }
+        
+        // Children always follow their parent, so every parent exists by now
+        for (size_t i = 0; i < node_count; ++i) {
+            const SnapshotNode& flat = flat_nodes[i];
+            if (flat.edge_count == 0) continue;
+            uint32_t capacity = 2;
+            while (capacity < flat.edge_count) capacity *= 2;
+            uint32_t slot = allocate_slot(capacity);
+            copy(flat_edges + flat.edge_begin, flat_edges + flat.edge_begin + flat.edge_count, 
+                 edges.begin() + slot);
+            nodes[i].edge_begin = slot;
+            nodes[i].edge_count = flat.edge_count;
+            nodes[i].edge_capacity = capacity;
+            for (uint32_t e = 0; e < flat.edge_count; ++e) {
+                nodes[flat_edges[flat.edge_begin + e].child].parent = static_cast<NodeIndex>(i);
+            }
+        }
+    }
+    
+    vector<PatternCount> get_frequent_patterns(int min_frequency, bool noncontiguous_only = false, 
+                                               PatternClosure closure = PatternClosure::All, 
+                                               QueryProfile* profile = nullptr) const {
+        vector<PatternCount> patterns;
+        vector<TokenId> current_pattern;
+        auto emit = [&](const vector<TokenId>& tokens, int frequency, bool is_noncontiguous) {
+            patterns.emplace_back(tokens, frequency, is_noncontiguous);
+        };
+        
+        collect_patterns(ROOT, min_frequency, noncontiguous_only, closure, closure_extensions(closure, min_frequency), 
+                         current_pattern, nullptr, profile, emit);
+        
+        // Sort by frequency (descending); ties keep token order from the DFS
+        auto sort_start = high_resolution_clock::now();
+        stable_sort(patterns.begin(), patterns.end(), 
+                    [](const auto& a, const auto& b) {
+                        return get<1>(a) > get<1>(b);
+                    });
+        if (profile) profile->sort_time += elapsed_ms(sort_start);
+        
+        return patterns;
+    }
+    
+    // Same ranking as the first k of get_frequent_patterns
+    vector<PatternCount> get_top_k_patterns(size_t k, int min_frequency, bool noncontiguous_only = false, 
+                                            PatternClosure closure = PatternClosure::All, 
+                                            QueryProfile* profile = nullptr) const {
+        TopKCollector top_k(k, min_frequency);
+        vector<TokenId> current_pattern;
+        auto emit = [&](const vector<TokenId>& tokens, int frequency, bool is_noncontiguous) {
+            top_k.offer(tokens, frequency, is_noncontiguous);
+        };
+        
+        collect_patterns(ROOT, min_frequency, noncontiguous_only, closure, closure_extensions(closure, min_frequency), 
+                         current_pattern, &top_k, profile, emit);
+        return top_k.take_sorted();
+    }
+    
+    // Calls visit(tokens, frequency, is_noncontiguous) for every frequent pattern in
+    // token order, straight from the traversal; tokens is only valid during the call
+    template <typename Visitor>
+    void for_each_frequent_pattern(int min_frequency, bool noncontiguous_only, PatternClosure closure, 
+                                   Visitor visit, QueryProfile* profile = nullptr) const {
+        vector<TokenId> current_pattern;
+        collect_patterns(ROOT, min_frequency, noncontiguous_only, closure, closure_extensions(closure, min_frequency), 
+                         current_pattern, nullptr, profile, visit);
+    }
+    
+    int get_pattern_count() const { return pattern_count; }
+    
+    // Pre-sizes the node arena and edge pool so they grow without reallocating
+    // (and briefly holding two copies) until node_capacity nodes exist. Pages
+    // of the reservation are only resident once nodes are written to them.
+    void reserve(size_t node_capacity) {
+        nodes.reserve(node_capacity);
+        edges.reserve(2 * node_capacity);
+    }
+    bool is_tracking_positions() const { return track_positions; }
+    
+    TrieMemoryReport memory_report() const {
+        TrieMemoryReport report;
+        report.node_count = nodes.size();
+        report.edge_count = nodes.size() - 1;
+        report.node_bytes = nodes.capacity() * sizeof(TrieNode);
+        report.edge_bytes = edges.capacity() * sizeof(TrieEdge);
+        report.position_bytes = postings.memory_bytes();
+        report.bytes_per_node = static_cast<double>(report.node_bytes + report.edge_bytes) / 
+                                report.node_count;
+        
+        // Old layout: make_shared block (two refcounts + node with map, vector,
+        // parent shared_ptr and scalars) plus one hash-map entry and bucket per edge
+        size_t legacy_node = 2 * sizeof(long) + sizeof(unordered_map<TokenId, shared_ptr<void>>) + 
+                             sizeof(vector<Position>) + sizeof(shared_ptr<void>) + 4 * sizeof(int);
+        size_t legacy_edge = sizeof(void*) + sizeof(pair<const TokenId, shared_ptr<void>>) + 
+                             sizeof(void*);
+        report.legacy_bytes_per_node = static_cast<double>(legacy_node * report.node_count + 
+                                                           legacy_edge * report.edge_count) / 
+                                       report.node_count;
+        return report;
+    }
+};
+
+// Sequence data structure. weight is the number of identical copies the entry
+// stands for (1 unless the miner deduplicates); engines count it as that many sequences.
+struct SequenceData {
+    int id;
+    vector<TokenId> sequence;
+    int length;
+    int weight;
+    
+    SequenceData(int i, vector<TokenId> seq, int w = 1) 
+        : id(i), sequence(move(seq)), length(static_cast<int>(sequence.size())), weight(w) {}
+};
+
+// Distance limits on the occurrences that are indexed. A gap is the number of
+// events skipped between two consecutive pattern events and the window is the
+// number of events from the first pattern event to the last, inclusive.
+// Negative limits mean no limit.
+struct GapConstraints {
+    int min_gap = 0;
+    int max_gap = -1;
+    int max_window = -1;
+    
+    bool active() const { return min_gap > 0 || max_gap >= 0 || max_window >= 0; }
+    
+    // Whether occurrences have a maximum span, so every one can be enumerated
+    bool bounded() const { return max_gap >= 0 || max_window >= 0; }
+    
+    // Clamps out-of-range values: gaps to >= 0, a window to at least one event
+    GapConstraints normalized() const {
+        GapConstraints result;
+        result.min_gap = max(min_gap, 0);
+        result.max_gap = max(max_gap, -1);
+        result.max_window = max_window < 0 ? -1 : max(max_window, 1);
+        return result;
+    }
+    
+    bool operator==(const GapConstraints& other) const {
+        return min_gap == other.min_gap && max_gap == other.max_gap && max_window == other.max_window;
+    }
+};
+
+// Depth-first walk over the gapped occurrences that start at first. Only positions
+// the constraints allow are ever visited, so the work is bounded by the
+// constraints rather than by the sequence length.
+template <typename Visitor>
+void extend_gapped_subsequence(const vector<TokenId>& sequence, int min_length, int max_length, 
+                               const GapConstraints& constraints, int first, int last, int window_end, 
+                               bool has_gap, vector<TokenId>& tokens, Visitor& visit) {
+    int length = static_cast<int>(tokens.size());
+    if (has_gap && length >= min_length) {
+        visit(tokens.data(), tokens.size(), first, true);
+    }
+    if (length >= max_length) return;
+    
+    int next_end = constraints.max_gap < 0 ? window_end : min(window_end, last + 1 + constraints.max_gap);
+    for (int p = last + 1 + constraints.min_gap; p <= next_end; ++p) {
+        tokens.push_back(sequence[p]);
+        extend_gapped_subsequence(sequence, min_length, max_length, constraints, first, p, window_end, 
+                                  has_gap || p > last + 1, tokens, visit);
+        tokens.pop_back();
+    }
 }
 
-vector<vector<string>> get_demo_data() {
-    return {
-        {"login", "browse", "search", "view_item", "add_to_cart", "checkout"},
-        {"login", "browse", "view_item", "add_to_cart", "checkout"},
-        {"browse", "search", "view_item", "browse", "view_item", "add_to_cart"},
-        {"login", "browse", "search", "view_item", "logout"},
-        {"browse", "search", "view_item", "add_to_cart", "checkout", "logout"},
-        {"login", "view_item", "add_to_cart", "checkout"},
-        {"browse", "search", "search", "view_item", "add_to_cart"}
-    };
+// Calls visit(tokens, length, start, is_noncontiguous) for every subsequence the
+// trie indexes: each contiguous window of min_length..max_length tokens, then,
+// for sequences of at most 20 tokens, each combination of positions (first 1000
+// bitmasks) in that length range. tokens is only valid during the call.
+// With a max_gap or max_window the caps do not apply: each occurrence that meets
+// the constraints is visited once, as a window when it has no gaps and as
+// non-contiguous otherwise. A min_gap alone bounds nothing, so it only filters
+// the capped enumeration, leaving single events and combinations spaced by it.
+template <typename Visitor>
+void for_each_subsequence(const vector<TokenId>& sequence, int min_length, int max_length, 
+                          Visitor visit, const GapConstraints& constraints = GapConstraints()) {
+    int sequence_len = static_cast<int>(sequence.size());
+    
+    if (constraints.bounded()) {
+        int longest_window = constraints.max_window < 0 ? sequence_len : constraints.max_window;
+        if (constraints.min_gap == 0) {
+            for (int length = min_length; length <= min({max_length, sequence_len, longest_window}); ++length) {
+                for (int start = 0; start <= sequence_len - length; ++start) {
+                    visit(sequence.data() + start, static_cast<size_t>(length), start, false);
+                }
+            }
+        } else if (min_length <= 1 && max_length >= 1) {
+            // Single events have no gap to violate
+            for (int start = 0; start < sequence_len; ++start) {
+                visit(sequence.data() + start, 1, start, false);
+            }
+        }
+        
+        vector<TokenId> tokens;
+        tokens.reserve(max(max_length, 1));
+        for (int first = 0; first < sequence_len; ++first) {
+            int window_end = min(sequence_len - 1, first + longest_window - 1);
+            tokens.assign(1, sequence[first]);
+            extend_gapped_subsequence(sequence, min_length, max_length, constraints, first, first, 
+                                      window_end, false, tokens, visit);
+        }
+        return;
+    }
+    
+    int min_gap = max(constraints.min_gap, 0);
+    if (min_gap == 0) {
+        // Contiguous windows are passed in place, not copied
+        for (int length = min_length; length <= min(max_length, sequence_len); ++length) {
+            for (int start = 0; start <= sequence_len - length; ++start) {
+                visit(sequence.data() + start, static_cast<size_t>(length), start, false);
+            }
+        }
+    } else if (min_length <= 1 && max_length >= 1) {
+        for (int start = 0; start < sequence_len; ++start) {
+            visit(sequence.data() + start, 1, start, false);
+        }
+    }
+    
+    // Non-contiguous subsequences (limited for performance)
+    if (sequence_len > 20) return;
+    
+    int max_combinations = min(1000, 1 << sequence_len);
+    vector<TokenId> subsequence;
+    subsequence.reserve(sequence_len);
+    
+    for (int i = 1; i < max_combinations; ++i) {
+        subsequence.clear();
+        int first_position = -1;
+        int last_position = -1;
+        bool spaced = true;
+        
+        for (int j = 0; j < sequence_len; ++j) {
+            if (i & (1 << j)) {
+                if (last_position >= 0 && j - last_position - 1 < min_gap) spaced = false;
+                subsequence.push_back(sequence[j]);
+                if (first_position < 0) first_position = j;
+                last_position = j;
+            }
+        }
+        
+        // Under a min_gap, single events were visited above
+        if (min_gap > 0 && (!spaced || subsequence.size() < 2)) continue;
+        if (static_cast<int>(subsequence.size()) >= min_length && 
+            static_cast<int>(subsequence.size()) <= max_length) {
+            visit(subsequence.data(), subsequence.size(), first_position < 0 ? 0 : first_position, true);
+        }
+    }
 }
 
-vector<vector<string>> get_user_input() {
-    cout << "\n" << string(50, '=') << endl;
-    cout << "INTERACTIVE SUBSEQUENCE MINER" << endl;
-    cout << string(50, '=') << endl;
+// PrefixSpan-style pattern growth over pseudo-projected suffix databases.
+// Only prefixes that meet min_support are extended, so long sequences are
+// mined exactly instead of being skipped. Frequency is the number of
+// sequences that contain the pattern as a (possibly gapped) subsequence.
+class PrefixSpanMiner {
+private:
+    // Suffix of sequence database[sequence] starting at start
+    struct ProjectedEntry {
+        uint32_t sequence;
+        uint32_t start;
+    };
     
-    vector<vector<string>> sequences;
-    cout << "\nEnter your sequences (space-separated elements per line)" << endl;
-    cout << "Type 'done' when finished, 'demo' for sample data:" << endl;
+    const vector<SequenceData>& database;
+    int min_length;
+    int max_length;
+    vector<int> item_counts;       // indexed by TokenId, reset after each scan
+    vector<uint64_t> item_stamps;  // last projected entry that counted the item
+    uint64_t stamp;
+    QueryProfile* profile;         // set for the duration of a mine call
+    PatternClosure closure;        // likewise
     
-    string line;
-    cin.ignore(); // Clear input buffer
+    // Items that extend the projected prefix with at least min_support, in token
+    // order, with their supports; each item is counted once per projected sequence,
+    // by that sequence's weight
+    vector<pair<TokenId, int>> count_extensions(const vector<ProjectedEntry>& projected, int min_support) {
+        vector<TokenId> touched;
+        for (const ProjectedEntry& entry : projected) {
+            const vector<TokenId>& sequence = database[entry.sequence].sequence;
+            int weight = database[entry.sequence].weight;
+            ++stamp;
+            for (size_t p = entry.start; p < sequence.size(); ++p) {
+                TokenId item = sequence[p];
+                if (item_stamps[item] == stamp) continue;
+                item_stamps[item] = stamp;
+                if (item_counts[item] == 0) touched.push_back(item);
+                item_counts[item] += weight;
+            }
+        }
+        
+        if (profile) profile->candidates += static_cast<long long>(touched.size());
+        
+        vector<pair<TokenId, int>> frequent_items;
+        for (TokenId item : touched) {
+            if (item_counts[item] >= min_support) {
+                frequent_items.emplace_back(item, item_counts[item]);
+            }
+            item_counts[item] = 0;
+        }
+        sort(frequent_items.begin(), frequent_items.end());
+        return frequent_items;
+    }
     
-    while (true) {
-        cout << "Sequence " << (sequences.size() + 1) << ": ";
-        getline(cin, line);
+    // BIDE's backward-extension check: whether some token inserted before one of
+    // the prefix's tokens still occurs in at least needed sequences. In a sequence,
+    // a token fits before prefix[i] exactly when it lies after the leftmost match
+    // of prefix[0..i) and before the rightmost match of prefix[i..] (the i-th
+    // maximum period). projected holds the parent prefix's suffixes.
+    bool has_backward_extension(const vector<ProjectedEntry>& projected, const vector<TokenId>& prefix, 
+                                int needed) {
+        size_t length = prefix.size();
+        vector<uint32_t> sequences;
+        vector<pair<uint32_t, uint32_t>> periods;  // length periods per sequence, [begin, end)
+        int total_weight = 0;
         
-        if (line == "done") {
-            break;
-        } else if (line == "demo") {
-            return get_demo_data();
-        } else if (!line.empty()) {
-            auto sequence = split_string(line);
-            sequences.push_back(sequence);
-            cout << "Added sequence: ";
+        for (const ProjectedEntry& entry : projected) {
+            const vector<TokenId>& sequence = database[entry.sequence].sequence;
+            if (find(sequence.begin() + entry.start, sequence.end(), prefix.back()) == sequence.end()) continue;
+            
+            vector<uint32_t> leftmost_end(length), rightmost_start(length);
+            size_t p = 0;
+            for (size_t k = 0; k < length; ++k) {
+                while (sequence[p] != prefix[k]) ++p;
+                leftmost_end[k] = static_cast<uint32_t>(p++);
+            }
+            p = sequence.size() - 1;
+            for (size_t k = length; k-- > 0;) {
+                while (sequence[p] != prefix[k]) --p;
+                rightmost_start[k] = static_cast<uint32_t>(p--);
+            }
+            
+            sequences.push_back(entry.sequence);
+            total_weight += database[entry.sequence].weight;
+            for (size_t i = 0; i < length; ++i) {
+                periods.emplace_back(i == 0 ? 0 : leftmost_end[i - 1] + 1, rightmost_start[i]);
+            }
+        }
+        
+        vector<TokenId> touched;
+        for (size_t i = 0; i < length; ++i) {
+            int best = 0;
+            int remaining = total_weight;
+            for (size_t j = 0; j < sequences.size(); ++j) {
+                // Stop once no token can still reach needed
+                if (best + remaining < needed) break;
+                
+                const vector<TokenId>& sequence = database[sequences[j]].sequence;
+                int weight = database[sequences[j]].weight;
+                remaining -= weight;
+                const auto& period = periods[j * length + i];
+                ++stamp;
+                for (uint32_t q = period.first; q < period.second; ++q) {
+                    TokenId item = sequence[q];
+                    if (item_stamps[item] == stamp) continue;
+                    item_stamps[item] = stamp;
+                    if (item_counts[item] == 0) touched.push_back(item);
+                    item_counts[item] += weight;
+                    best = max(best, item_counts[item]);
+                }
+            }
+            
+            for (TokenId item : touched) item_counts[item] = 0;
+            touched.clear();
+            if (best >= needed) return true;
+        }
+        return false;
+    }
+    
+    // Appends to patterns, or offers to top_k (and prunes by its threshold) when given.
+    // frequent_items are the extensions of prefix found in projected.
+    void grow(const vector<ProjectedEntry>& projected, const vector<pair<TokenId, int>>& frequent_items, 
+              int min_support, vector<TokenId>& prefix, vector<PatternCount>& patterns, 
+              TopKCollector* top_k) {
+        for (const auto& item_pair : frequent_items) {
+            // Extensions cannot beat their prefix's support
+            if (top_k && item_pair.second < top_k->threshold()) continue;
+            
+            TokenId item = item_pair.first;
+            prefix.push_back(item);
+            bool extendable = static_cast<int>(prefix.size()) < max_length;
+            
+            // Project on the first occurrence of the item in each suffix
+            vector<ProjectedEntry> next;
+            int next_weight = 0;
+            if (extendable) {
+                next.reserve(min(static_cast<size_t>(item_pair.second), projected.size()));
+                for (const ProjectedEntry& entry : projected) {
+                    const vector<TokenId>& sequence = database[entry.sequence].sequence;
+                    for (size_t p = entry.start; p < sequence.size(); ++p) {
+                        if (sequence[p] == item) {
+                            if (p + 1 < sequence.size()) {
+                                next.push_back({entry.sequence, static_cast<uint32_t>(p + 1)});
+                                next_weight += database[entry.sequence].weight;
+                            }
+                            break;
+                        }
+                    }
+                }
+            }
+            
+            // Closure needs the forward extensions before the pattern is reported
+            vector<pair<TokenId, int>> extensions;
+            bool counted = false;
+            if (extendable && closure != PatternClosure::All) {
+                extensions = count_extensions(next, min_support);
+                counted = true;
+            }
+            
+            if (static_cast<int>(prefix.size()) >= min_length && 
+                (!top_k || item_pair.second >= top_k->threshold())) {
+                bool reported = true;
+                if (extendable && closure != PatternClosure::All) {
+                    int needed = closure == PatternClosure::Closed ? item_pair.second : min_support;
+                    bool forward = any_of(extensions.begin(), extensions.end(), 
+                                          [&](const pair<TokenId, int>& e) { return e.second >= needed; });
+                    reported = !forward && !has_backward_extension(projected, prefix, needed);
+                }
+                if (reported) {
+                    if (top_k) {
+                        top_k->offer(prefix, item_pair.second, true);
+                    } else {
+                        patterns.emplace_back(prefix, item_pair.second, true);
+                    }
+                }
+            }
+            
+            int threshold = top_k ? top_k->threshold() : min_support;
+            if (extendable && next_weight >= threshold) {
+                if (!counted) extensions = count_extensions(next, min_support);
+                grow(next, extensions, min_support, prefix, patterns, top_k);
+            }
+            
+            prefix.pop_back();
+        }
+    }
+    
+    vector<ProjectedEntry> whole_database() const {
+        vector<ProjectedEntry> projected;
+        projected.reserve(database.size());
+        for (size_t i = 0; i < database.size(); ++i) {
+            projected.push_back({static_cast<uint32_t>(i), 0});
+        }
+        return projected;
+    }
+    
+public:
+    PrefixSpanMiner(const vector<SequenceData>& db, size_t alphabet_size, int min_len, int max_len)
+        : database(db), min_length(min_len), max_length(max_len), 
+          item_counts(alphabet_size, 0), item_stamps(alphabet_size, 0), stamp(0), profile(nullptr), 
+          closure(PatternClosure::All) {}
+    
+    vector<PatternCount> mine(int min_support, PatternClosure pattern_closure = PatternClosure::All, 
+                              QueryProfile* query_profile = nullptr) {
+        vector<PatternCount> patterns;
+        vector<TokenId> prefix;
+        min_support = max(min_support, 1);
+        
+        profile = query_profile;
+        closure = pattern_closure;
+        vector<ProjectedEntry> projected = whole_database();
+        grow(projected, count_extensions(projected, min_support), min_support, prefix, patterns, nullptr);
+        profile = nullptr;
+        
+        // Sort by frequency (descending); ties keep token order from the search
+        auto sort_start = high_resolution_clock::now();
+        stable_sort(patterns.begin(), patterns.end(), 
+                    [](const auto& a, const auto& b) {
+                        return get<1>(a) > get<1>(b);
+                    });
+        if (query_profile) query_profile->sort_time += elapsed_ms(sort_start);
+        
+        return patterns;
+    }
+    
+    // Same ranking as the first k of mine
+    vector<PatternCount> mine_top_k(size_t k, int min_support, 
+                                    PatternClosure pattern_closure = PatternClosure::All, 
+                                    QueryProfile* query_profile = nullptr) {
+        TopKCollector top_k(k, min_support);
+        vector<PatternCount> unused;
+        vector<TokenId> prefix;
+        min_support = max(min_support, 1);
+        
+        profile = query_profile;
+        closure = pattern_closure;
+        vector<ProjectedEntry> projected = whole_database();
+        grow(projected, count_extensions(projected, min_support), min_support, prefix, unused, &top_k);
+        profile = nullptr;
+        return top_k.take_sorted();
+    }
+};
+
+// Generalized suffix automaton over the encoded sequence database. Every
+// contiguous pattern maps to one state, and all patterns of a state occur in
+// the same sequences, so per-sequence support is counted once per state
+// rather than once per window and length.
+class SuffixAutomaton {
+private:
+    static constexpr uint32_t NO_STATE = numeric_limits<uint32_t>::max();
+    
+    struct State {
+        int len;                               // longest pattern in the state
+        uint32_t link;                         // suffix link
+        vector<pair<TokenId, uint32_t>> next;  // transitions, sorted by token
+        int support;                           // sequences containing the state, by weight
+        int last_sequence;                     // last sequence that counted this state
+        uint32_t end_sequence;                 // one occurrence, to spell the patterns
+        uint32_t end_position;
+        
+        State(int l, uint32_t lk)
+            : len(l), link(lk), support(0), last_sequence(-1), end_sequence(0), end_position(0) {}
+    };
+    
+    vector<State> states;
+    
+    uint32_t transition(uint32_t state, TokenId token) const {
+        const auto& next = states[state].next;
+        auto it = lower_bound(next.begin(), next.end(), make_pair(token, uint32_t(0)));
+        return (it != next.end() && it->first == token) ? it->second : NO_STATE;
+    }
+    
+    void set_transition(uint32_t state, TokenId token, uint32_t target) {
+        auto& next = states[state].next;
+        auto it = lower_bound(next.begin(), next.end(), make_pair(token, uint32_t(0)));
+        if (it != next.end() && it->first == token) {
+            it->second = target;
+        } else {
+            next.insert(it, make_pair(token, target));
+        }
+    }
+    
+    uint32_t clone_state(uint32_t q, int len) {
+        uint32_t clone = static_cast<uint32_t>(states.size());
+        states.emplace_back(len, states[q].link);
+        states[clone].next = states[q].next;
+        states[q].link = clone;
+        return clone;
+    }
+    
+    // Online extension that tolerates restarting from the root for each sequence
+    uint32_t extend(uint32_t last, TokenId token) {
+        uint32_t existing = transition(last, token);
+        if (existing != NO_STATE) {
+            if (states[existing].len == states[last].len + 1) return existing;
+            
+            uint32_t clone = clone_state(existing, states[last].len + 1);
+            for (uint32_t p = last; p != NO_STATE && transition(p, token) == existing; 
+                 p = states[p].link) {
+                set_transition(p, token, clone);
+            }
+            return clone;
+        }
+        
+        uint32_t current = static_cast<uint32_t>(states.size());
+        states.emplace_back(states[last].len + 1, 0);
+        
+        uint32_t p = last;
+        while (p != NO_STATE && transition(p, token) == NO_STATE) {
+            set_transition(p, token, current);
+            p = states[p].link;
+        }
+        
+        if (p != NO_STATE) {
+            uint32_t q = transition(p, token);
+            if (states[p].len + 1 == states[q].len) {
+                states[current].link = q;
+            } else {
+                uint32_t clone = clone_state(q, states[p].len + 1);
+                for (; p != NO_STATE && transition(p, token) == q; p = states[p].link) {
+                    set_transition(p, token, clone);
+                }
+                states[current].link = clone;
+            }
+        }
+        
+        return current;
+    }
+    
+public:
+    SuffixAutomaton() {
+        states.emplace_back(0, NO_STATE);
+    }
+    
+    void build(const vector<SequenceData>& database) {
+        states.clear();
+        states.emplace_back(0, NO_STATE);
+        
+        for (const auto& seq_data : database) {
+            uint32_t last = 0;
+            for (TokenId token : seq_data.sequence) {
+                last = extend(last, token);
+            }
+        }
+        
+        // Each prefix end state and its suffix-link ancestors hold every
+        // substring of the sequence; stop climbing at the first state this
+        // sequence already counted.
+        for (size_t slot = 0; slot < database.size(); ++slot) {
+            const vector<TokenId>& sequence = database[slot].sequence;
+            int sequence_mark = static_cast<int>(slot);
+            uint32_t state = 0;
+            
             for (size_t i = 0; i < sequence.size(); ++i) {
-                if (i > 0) cout << " -> ";
-                cout << sequence[i];
+                state = transition(state, sequence[i]);
+                for (uint32_t v = state; v != 0 && states[v].last_sequence != sequence_mark; 
+                     v = states[v].link) {
+                    State& s = states[v];
+                    if (s.support == 0) {
+                        s.end_sequence = static_cast<uint32_t>(slot);
+                        s.end_position = static_cast<uint32_t>(i);
+                    }
+                    s.last_sequence = sequence_mark;
+                    s.support += database[slot].weight;
+                }
+            }
+        }
+    }
+    
+    vector<PatternCount> get_frequent_patterns(const vector<SequenceData>& database, int min_support, 
+                                               int min_length, int max_length, 
+                                               QueryProfile* profile = nullptr) const {
+        vector<PatternCount> patterns;
+        if (profile) profile->candidates += static_cast<long long>(states.size() - 1);
+        
+        for (size_t v = 1; v < states.size(); ++v) {
+            const State& s = states[v];
+            if (s.support < min_support) continue;
+            
+            int shortest = max(states[s.link].len + 1, min_length);
+            int longest = min(s.len, max_length);
+            const vector<TokenId>& sequence = database[s.end_sequence].sequence;
+            
+            for (int length = shortest; length <= longest; ++length) {
+                auto end = sequence.begin() + s.end_position + 1;
+                patterns.emplace_back(vector<TokenId>(end - length, end), s.support, false);
+            }
+        }
+        
+        // Frequency descending, then token order, matching the trie's DFS order
+        auto sort_start = high_resolution_clock::now();
+        sort(patterns.begin(), patterns.end(), 
+             [](const auto& a, const auto& b) {
+                 if (get<1>(a) != get<1>(b)) return get<1>(a) > get<1>(b);
+                 return get<0>(a) < get<0>(b);
+             });
+        if (profile) profile->sort_time += elapsed_ms(sort_start);
+        
+        return patterns;
+    }
+    
+    // Same ranking as the first k of get_frequent_patterns; patterns are spelled
+    // straight from the sequence and only copied if they enter the heap
+    vector<PatternCount> get_top_k_patterns(const vector<SequenceData>& database, size_t k, 
+                                            int min_support, int min_length, int max_length, 
+                                            QueryProfile* profile = nullptr) const {
+        TopKCollector top_k(k, min_support);
+        if (profile) profile->candidates += static_cast<long long>(states.size() - 1);
+        
+        for (size_t v = 1; v < states.size(); ++v) {
+            const State& s = states[v];
+            if (s.support < top_k.threshold()) continue;
+            
+            int shortest = max(states[s.link].len + 1, min_length);
+            int longest = min(s.len, max_length);
+            const TokenId* end = database[s.end_sequence].sequence.data() + s.end_position + 1;
+            
+            for (int length = shortest; length <= longest; ++length) {
+                top_k.offer(end - length, static_cast<size_t>(length), s.support, false);
+            }
+        }
+        
+        return top_k.take_sorted();
+    }
+    
+    size_t state_count() const { return states.size(); }
+    
+    size_t transition_count() const {
+        size_t total = 0;
+        for (const State& s : states) total += s.next.size();
+        return total;
+    }
+    
+    size_t memory_bytes() const {
+        size_t bytes = states.capacity() * sizeof(State);
+        for (const State& s : states) bytes += s.next.capacity() * sizeof(pair<TokenId, uint32_t>);
+        return bytes;
+    }
+};
+
+// SPAM/SPADE-style vertical index: for every item, one bitmap of the positions
+// where it occurs, laid out sequence by sequence. Sequences are grouped into
+// blocks of equal width (in 64-bit words) so the kernels below can treat a
+// block as a flat array. Growing a pattern is a transform of the prefix
+// bitmap (shift for the next position, fill-after-first-bit for any later
+// position) ANDed with the item bitmap; support is the number of sequences
+// left with a non-zero section.
+class VerticalBitmapIndex {
+private:
+    struct Block {
+        uint32_t words;     // words per sequence
+        size_t first_word;  // offset of the block in every bitmap
+        size_t sequences;
+        int weight;         // shared by the block's sequences, so counts scale by it
+    };
+    
+    vector<Block> blocks;
+    size_t total_words;
+    vector<vector<uint64_t>> item_bitmaps;  // by TokenId; empty if the item never occurs
+    vector<int> item_support;
+    
+    // Any later position: keep only bits above the first set bit of each sequence
+    static void any_later_transform(const uint64_t* in, uint64_t* out, size_t sequences, uint32_t words) {
+        if (words == 1) {
+            size_t i = 0;
+#if defined(__AVX2__)
+            const __m256i zero = _mm256_setzero_si256();
+            const __m256i one = _mm256_set1_epi64x(1);
+            const __m256i all = _mm256_set1_epi64x(-1);
+            for (; i + 4 <= sequences; i += 4) {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+                __m256i low = _mm256_and_si256(x, _mm256_sub_epi64(zero, x));
+                __m256i upto = _mm256_or_si256(low, _mm256_sub_epi64(low, one));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_andnot_si256(upto, all));
+            }
+#endif
+            for (; i < sequences; ++i) {
+                uint64_t low = in[i] & (~in[i] + 1);
+                out[i] = ~(low | (low - 1));
+            }
+            return;
+        }
+        
+        for (size_t s = 0; s < sequences; ++s) {
+            bool seen = false;
+            for (uint32_t w = 0; w < words; ++w) {
+                uint64_t x = in[s * words + w];
+                if (seen) {
+                    out[s * words + w] = ~uint64_t(0);
+                } else if (x) {
+                    uint64_t low = x & (~x + 1);
+                    out[s * words + w] = ~(low | (low - 1));
+                    seen = true;
+                } else {
+                    out[s * words + w] = 0;
+                }
+            }
+        }
+    }
+    
+    // Next position: shift each sequence's bits up by one, carrying across words
+    static void next_position_transform(const uint64_t* in, uint64_t* out, size_t sequences, uint32_t words) {
+        if (words == 1) {
+            size_t i = 0;
+#if defined(__AVX2__)
+            for (; i + 4 <= sequences; i += 4) {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_slli_epi64(x, 1));
+            }
+#endif
+            for (; i < sequences; ++i) {
+                out[i] = in[i] << 1;
+            }
+            return;
+        }
+        
+        for (size_t s = 0; s < sequences; ++s) {
+            uint64_t carry = 0;
+            for (uint32_t w = 0; w < words; ++w) {
+                uint64_t x = in[s * words + w];
+                out[s * words + w] = (x << 1) | carry;
+                carry = x >> 63;
+            }
+        }
+    }
+    
+    // out = a & b; returns the number of sequences with a non-zero result
+    static int and_count(const uint64_t* a, const uint64_t* b, uint64_t* out, 
+                         size_t sequences, uint32_t words) {
+        int count = 0;
+        
+        if (words == 1) {
+            size_t i = 0;
+#if defined(__AVX2__)
+            const __m256i zero = _mm256_setzero_si256();
+            for (; i + 4 <= sequences; i += 4) {
+                __m256i r = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)), 
+                                             _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), r);
+                int empty = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(r, zero)));
+                count += 4 - __builtin_popcount(static_cast<unsigned>(empty));
+            }
+#endif
+            for (; i < sequences; ++i) {
+                out[i] = a[i] & b[i];
+                count += out[i] != 0;
+            }
+            return count;
+        }
+        
+        for (size_t s = 0; s < sequences; ++s) {
+            uint64_t any = 0;
+            for (uint32_t w = 0; w < words; ++w) {
+                size_t i = s * words + w;
+                out[i] = a[i] & b[i];
+                any |= out[i];
+            }
+            count += any != 0;
+        }
+        return count;
+    }
+    
+    void transform(const vector<uint64_t>& in, vector<uint64_t>& out, bool any_later) const {
+        for (const Block& block : blocks) {
+            if (any_later) {
+                any_later_transform(in.data() + block.first_word, out.data() + block.first_word, 
+                                    block.sequences, block.words);
+            } else {
+                next_position_transform(in.data() + block.first_word, out.data() + block.first_word, 
+                                        block.sequences, block.words);
+            }
+        }
+    }
+    
+    int intersect(const vector<uint64_t>& prefix, const vector<uint64_t>& item, 
+                  vector<uint64_t>& out) const {
+        int support = 0;
+        for (const Block& block : blocks) {
+            support += block.weight * and_count(prefix.data() + block.first_word, item.data() + block.first_word, 
+                                                out.data() + block.first_word, block.sequences, block.words);
+        }
+        return support;
+    }
+    
+    // Scratch bitmaps per depth: gapped / contiguous occurrence ends and their transforms
+    struct Scratch {
+        vector<vector<uint64_t>> gapped, contiguous, gapped_step, contiguous_step;
+        long long candidates = 0;  // extensions whose support was computed
+    };
+    
+    // Appends to patterns, or offers to top_k (and prunes by its threshold) when given
+    void grow(size_t depth, const vector<TokenId>& frequent_items, int min_support, int min_length, 
+              int max_length, bool noncontiguous_only, vector<TokenId>& prefix, Scratch& scratch, 
+              vector<PatternCount>& patterns, TopKCollector* top_k) const {
+        const vector<uint64_t>& gapped = depth == 1 ? item_bitmaps[prefix[0]] : scratch.gapped[depth];
+        const vector<uint64_t>& contiguous = depth == 1 ? item_bitmaps[prefix[0]] : scratch.contiguous[depth];
+        transform(gapped, scratch.gapped_step[depth], true);
+        transform(contiguous, scratch.contiguous_step[depth], false);
+        
+        for (TokenId item : frequent_items) {
+            scratch.candidates++;
+            int gapped_support = intersect(scratch.gapped_step[depth], item_bitmaps[item], 
+                                           scratch.gapped[depth + 1]);
+            if (gapped_support < (top_k ? top_k->threshold() : min_support)) continue;
+            int contiguous_support = intersect(scratch.contiguous_step[depth], item_bitmaps[item], 
+                                               scratch.contiguous[depth + 1]);
+            
+            // Non-contiguous when some supporting sequence only has it with gaps
+            bool is_noncontiguous = gapped_support > contiguous_support;
+            prefix.push_back(item);
+            
+            if (static_cast<int>(prefix.size()) >= min_length && 
+                (!noncontiguous_only || is_noncontiguous)) {
+                if (top_k) {
+                    top_k->offer(prefix, gapped_support, is_noncontiguous);
+                } else {
+                    patterns.emplace_back(prefix, gapped_support, is_noncontiguous);
+                }
+            }
+            if (static_cast<int>(prefix.size()) < max_length) {
+                grow(depth + 1, frequent_items, min_support, min_length, max_length, 
+                     noncontiguous_only, prefix, scratch, patterns, top_k);
+            }
+            
+            prefix.pop_back();
+        }
+    }
+    
+public:
+    VerticalBitmapIndex() : total_words(0) {}
+    
+    void build(const vector<SequenceData>& database, size_t alphabet_size) {
+        blocks.clear();
+        item_bitmaps.assign(alphabet_size, vector<uint64_t>());
+        item_support.assign(alphabet_size, 0);
+        
+        // Blocks group sequences by width and weight
+        map<pair<uint32_t, int>, vector<size_t>> slots_by_width;
+        for (size_t slot = 0; slot < database.size(); ++slot) {
+            uint32_t words = static_cast<uint32_t>(max<size_t>(1, (database[slot].sequence.size() + 63) / 64));
+            slots_by_width[{words, database[slot].weight}].push_back(slot);
+        }
+        
+        total_words = 0;
+        for (const auto& width_pair : slots_by_width) {
+            blocks.push_back({width_pair.first.first, total_words, width_pair.second.size(), 
+                              width_pair.first.second});
+            total_words += static_cast<size_t>(width_pair.first.first) * width_pair.second.size();
+        }
+        
+        size_t block_index = 0;
+        for (const auto& width_pair : slots_by_width) {
+            const Block& block = blocks[block_index++];
+            for (size_t j = 0; j < width_pair.second.size(); ++j) {
+                const vector<TokenId>& sequence = database[width_pair.second[j]].sequence;
+                size_t base = block.first_word + j * block.words;
+                
+                for (size_t p = 0; p < sequence.size(); ++p) {
+                    vector<uint64_t>& bitmap = item_bitmaps[sequence[p]];
+                    if (bitmap.empty()) bitmap.assign(total_words, 0);
+                    
+                    uint64_t& word = bitmap[base + p / 64];
+                    bool first_in_sequence = true;
+                    for (uint32_t w = 0; w < block.words; ++w) {
+                        if (bitmap[base + w]) first_in_sequence = false;
+                    }
+                    if (first_in_sequence) item_support[sequence[p]] += block.weight;
+                    word |= uint64_t(1) << (p % 64);
+                }
+            }
+        }
+    }
+    
+    // Offers to top_k instead of returning everything when it is given
+    vector<PatternCount> get_frequent_patterns(int min_support, int min_length, int max_length, 
+                                               bool noncontiguous_only, 
+                                               TopKCollector* top_k = nullptr, 
+                                               QueryProfile* profile = nullptr) const {
+        vector<PatternCount> patterns;
+        min_support = max(min_support, 1);
+        
+        vector<TokenId> frequent_items;
+        for (size_t item = 0; item < item_support.size(); ++item) {
+            if (item_support[item] >= min_support) {
+                frequent_items.push_back(static_cast<TokenId>(item));
+            }
+        }
+        
+        Scratch scratch;
+        size_t depth_limit = static_cast<size_t>(max(max_length, 1)) + 1;
+        scratch.gapped.assign(depth_limit + 1, vector<uint64_t>(total_words));
+        scratch.contiguous.assign(depth_limit + 1, vector<uint64_t>(total_words));
+        scratch.gapped_step.assign(depth_limit, vector<uint64_t>(total_words));
+        scratch.contiguous_step.assign(depth_limit, vector<uint64_t>(total_words));
+        
+        vector<TokenId> prefix;
+        for (TokenId item : frequent_items) {
+            if (top_k && item_support[item] < top_k->threshold()) continue;
+            
+            prefix.push_back(item);
+            if (min_length <= 1 && !noncontiguous_only) {
+                if (top_k) {
+                    top_k->offer(prefix, item_support[item], false);
+                } else {
+                    patterns.emplace_back(prefix, item_support[item], false);
+                }
+            }
+            if (max_length > 1) {
+                grow(1, frequent_items, min_support, min_length, max_length, noncontiguous_only, 
+                     prefix, scratch, patterns, top_k);
+            }
+            prefix.pop_back();
+        }
+        
+        if (profile) {
+            profile->candidates += scratch.candidates + static_cast<long long>(item_support.size());
+        }
+        if (top_k) return top_k->take_sorted();
+        
+        // Frequency descending, then token order, matching the trie's DFS order
+        auto sort_start = high_resolution_clock::now();
+        sort(patterns.begin(), patterns.end(), 
+             [](const auto& a, const auto& b) {
+                 if (get<1>(a) != get<1>(b)) return get<1>(a) > get<1>(b);
+                 return get<0>(a) < get<0>(b);
+             });
+        if (profile) profile->sort_time += elapsed_ms(sort_start);
+        
+        return patterns;
+    }
+    
+    size_t memory_bytes() const {
+        size_t bytes = blocks.capacity() * sizeof(Block) + item_support.capacity() * sizeof(int) + 
+                       item_bitmaps.capacity() * sizeof(vector<uint64_t>);
+        for (const auto& bitmap : item_bitmaps) bytes += bitmap.capacity() * sizeof(uint64_t);
+        return bytes;
+    }
+    
+    static const char* kernel_name() {
+#if defined(__AVX2__)
+        return "AVX2";
+#else
+        return "scalar";
+#endif
+    }
+};
+
+// Open-addressing count table keyed by packed n-grams. Slots hold the key and
+// its count side by side and collisions probe linearly, so an update usually
+// touches one cache line. Key 0 marks an empty slot; packed keys are never 0
+// because every field holds a token id + 1.
+template <typename Key>
+class PackedCountTable {
+private:
+    struct Slot {
+        Key key;
+        int count;
+    };
+    
+    vector<Slot> slots;
+    size_t used;
+    int shift;  // 64 - log2(slots.size()), for multiplicative hashing
+    
+    static uint64_t fold(uint64_t key) { return key; }
+    static uint64_t fold(unsigned __int128 key) {
+        return static_cast<uint64_t>(key) ^ (static_cast<uint64_t>(key >> 64) * 0xC2B2AE3D27D4EB4Full);
+    }
+    
+    size_t home(Key key) const { return static_cast<size_t>((fold(key) * 0x9E3779B97F4A7C15ull) >> shift); }
+    
+    Slot& find_slot(Key key) {
+        size_t mask = slots.size() - 1;
+        size_t i = home(key);
+        while (slots[i].key != key && slots[i].key != 0) i = (i + 1) & mask;
+        return slots[i];
+    }
+    
+    void resize(size_t capacity) {
+        vector<Slot> old = move(slots);
+        slots.assign(capacity, Slot{0, 0});
+        shift = 64 - __builtin_ctzll(capacity);
+        for (const Slot& slot : old) {
+            if (slot.key != 0) find_slot(slot.key) = slot;
+        }
+    }
+    
+public:
+    explicit PackedCountTable(size_t capacity = 1024) : used(0), shift(64) {
+        size_t size = 16;
+        while (size < capacity) size *= 2;
+        resize(size);
+    }
+    
+    void add(Key key, int count = 1) {
+        Slot& slot = find_slot(key);
+        if (slot.key != 0) {
+            slot.count += count;
+            return;
+        }
+        slot.key = key;
+        slot.count = count;
+        // Grow at 70% load; linear probing degrades quickly past that
+        if (++used * 10 > slots.size() * 7) resize(slots.size() * 2);
+    }
+    
+    // Adds a run of keys, prefetching every key's slot before the first update
+    // so the cache misses of a large table overlap instead of queueing
+    void add_batch(const Key* keys, size_t count, int weight = 1) {
+        for (size_t i = 0; i < count; ++i) __builtin_prefetch(&slots[home(keys[i])], 1);
+        for (size_t i = 0; i < count; ++i) add(keys[i], weight);
+    }
+    
+    void merge_from(const PackedCountTable& other) {
+        for (const Slot& slot : other.slots) {
+            if (slot.key != 0) add(slot.key, slot.count);
+        }
+    }
+    
+    // visit(key, count) for every entry, in slot order
+    template <typename Visitor>
+    void for_each(Visitor visit) const {
+        for (const Slot& slot : slots) {
+            if (slot.key != 0) visit(slot.key, slot.count);
+        }
+    }
+    
+    size_t size() const { return used; }
+    size_t memory_bytes() const { return slots.capacity() * sizeof(Slot); }
+};
+
+template <int Bits>
+using PackedKey = conditional_t<(Bits <= 64), uint64_t, unsigned __int128>;
+
+// Counts the contiguous n-grams of min_length..MaxLength tokens in
+// database[first, last). Each sequence is scanned once: a rolling key holds its
+// last MaxLength ids as IdBits-wide fields, so the n-gram of length L ending at
+// a position is that key's low L fields, one AND away.
+template <int MaxLength, int IdBits>
+void count_packed_ngrams(const vector<SequenceData>& database, size_t first, size_t last, int min_length, 
+                         PackedCountTable<PackedKey<MaxLength * IdBits>>& table) {
+    using Key = PackedKey<MaxLength * IdBits>;
+    constexpr int KEY_BITS = static_cast<int>(sizeof(Key) * 8);
+    Key masks[MaxLength + 1];
+    for (int length = 0; length <= MaxLength; ++length) {
+        masks[length] = length * IdBits >= KEY_BITS ? ~Key(0) : (Key(1) << (length * IdBits)) - 1;
+    }
+    int shortest = max(min_length, 1);
+    
+    constexpr size_t BATCH = 32;
+    Key pending[BATCH + MaxLength];
+    size_t count = 0;
+    int pending_weight = 1;  // a batch only holds keys of one weight
+    for (size_t slot = first; slot < last; ++slot) {
+        const vector<TokenId>& sequence = database[slot].sequence;
+        if (database[slot].weight != pending_weight) {
+            table.add_batch(pending, count, pending_weight);
+            count = 0;
+            pending_weight = database[slot].weight;
+        }
+        Key window = 0;
+        for (size_t i = 0; i < sequence.size(); ++i) {
+            window = ((window << IdBits) | Key(sequence[i] + 1)) & masks[MaxLength];
+            int longest = static_cast<int>(min<size_t>(i + 1, MaxLength));
+            for (int length = shortest; length <= longest; ++length) {
+                pending[count++] = window & masks[length];
+            }
+            if (count >= BATCH) {
+                table.add_batch(pending, count, pending_weight);
+                count = 0;
+            }
+        }
+    }
+    table.add_batch(pending, count, pending_weight);
+}
+
+// Calls fn(integral_constant<MaxLength>, integral_constant<IdBits>) for the
+// instantiation matching max_length; false if that shape does not pack into
+// 128 bits or is longer than 8
+template <int IdBits, int MaxLength, typename Fn>
+bool dispatch_packed_shape(int max_length, Fn& fn) {
+    if constexpr (MaxLength > 8 || MaxLength * IdBits > 128) {
+        return false;
+    } else {
+        if (max_length == MaxLength) {
+            fn(integral_constant<int, MaxLength>(), integral_constant<int, IdBits>());
+            return true;
+        }
+        return dispatch_packed_shape<IdBits, MaxLength + 1>(max_length, fn);
+    }
+}
+
+template <typename Fn>
+bool dispatch_packed_ngrams(int max_length, int id_bits, Fn fn) {
+    switch (id_bits) {
+        case 8: return dispatch_packed_shape<8, 1>(max_length, fn);
+        case 16: return dispatch_packed_shape<16, 1>(max_length, fn);
+        case 32: return dispatch_packed_shape<32, 1>(max_length, fn);
+    }
+    return false;
+}
+
+// Contiguous patterns with occurrence counts (the count the trie gives a
+// window), for short patterns over modest alphabets. Each n-gram is packed
+// into one 64- or 128-bit key and counted in a PackedCountTable by a loop
+// compiled for the exact max_length and id width, chosen at build time.
+// Shapes that do not pack (max_length over 8, or 32-bit ids past length 4)
+// fall back to a hash map keyed by the raw tokens.
+class PackedNgramIndex {
+private:
+    int min_length;
+    int max_length;
+    int id_bits;  // field width of the packed keys; 0 when the fallback is used
+    PackedCountTable<uint64_t> narrow;
+    PackedCountTable<unsigned __int128> wide;
+    unordered_map<string, int> fallback;  // TokenId bytes -> count
+    
+    template <typename Key>
+    PackedCountTable<Key>& table() {
+        if constexpr (is_same<Key, uint64_t>::value) return narrow;
+        else return wide;
+    }
+    
+    template <int MaxLength, int IdBits>
+    void build_packed(const vector<SequenceData>& database, int threads) {
+        using Key = PackedKey<MaxLength * IdBits>;
+        PackedCountTable<Key>& target = table<Key>();
+        size_t workers = min<size_t>(static_cast<size_t>(max(threads, 1)), database.size() / 1024 + 1);
+        if (workers == 1) {
+            count_packed_ngrams<MaxLength, IdBits>(database, 0, database.size(), min_length, target);
+            return;
+        }
+        
+        // Private tables per slice, merged afterwards: no sharing while counting
+        vector<PackedCountTable<Key>> partial(workers);
+        vector<thread> counters;
+        for (size_t w = 0; w < workers; ++w) {
+            counters.emplace_back([&, w]() {
+                count_packed_ngrams<MaxLength, IdBits>(database, database.size() * w / workers, 
+                                                       database.size() * (w + 1) / workers, 
+                                                       min_length, partial[w]);
+            });
+        }
+        for (auto& counter : counters) counter.join();
+        for (const auto& counts : partial) target.merge_from(counts);
+    }
+    
+    // visit(tokens, length, count) for entries that meet min_support, or the
+    // collector's threshold; keys are only unpacked for those
+    template <typename Visitor>
+    void for_each_pattern(int min_support, const TopKCollector* top_k, QueryProfile* profile, 
+                          Visitor visit) const {
+        TokenId tokens[8];
+        auto unpack = [&](auto key, int count) {
+            if (profile) profile->candidates++;
+            if (count < (top_k ? top_k->threshold() : min_support)) return;
+            const auto field = (decltype(key)(1) << id_bits) - 1;
+            size_t length = 0;
+            for (int i = max_length - 1; i >= 0; --i) {
+                TokenId value = static_cast<TokenId>((key >> (i * id_bits)) & field);
+                if (value != 0) tokens[length++] = value - 1;
+            }
+            visit(tokens, length, count);
+        };
+        
+        if (id_bits == 0) {
+            for (const auto& entry : fallback) {
+                if (profile) profile->candidates++;
+                if (entry.second < (top_k ? top_k->threshold() : min_support)) continue;
+                vector<TokenId> pattern(entry.first.size() / sizeof(TokenId));
+                memcpy(pattern.data(), entry.first.data(), entry.first.size());
+                visit(pattern.data(), pattern.size(), entry.second);
+            }
+        } else if (max_length * id_bits <= 64) {
+            narrow.for_each(unpack);
+        } else {
+            wide.for_each(unpack);
+        }
+    }
+    
+public:
+    PackedNgramIndex() : min_length(1), max_length(0), id_bits(0), narrow(16), wide(16) {}
+    
+    // alphabet is the number of interned symbols; ids must stay below it
+    void build(const vector<SequenceData>& database, size_t alphabet, int min_len, int max_len, 
+               int threads = 1) {
+        min_length = min_len;
+        max_length = max_len;
+        narrow = PackedCountTable<uint64_t>();
+        wide = PackedCountTable<unsigned __int128>();
+        fallback.clear();
+        
+        // Fields store id + 1, so the alphabet must stay below 2^bits
+        id_bits = alphabet < (1u << 8) ? 8 : alphabet < (1u << 16) ? 16 : 32;
+        bool packed = dispatch_packed_ngrams(max_length, id_bits, [&](auto max_tag, auto bits_tag) {
+            build_packed<decltype(max_tag)::value, decltype(bits_tag)::value>(database, threads);
+        });
+        if (packed) return;
+        
+        id_bits = 0;
+        for (const auto& seq_data : database) {
+            const vector<TokenId>& sequence = seq_data.sequence;
+            int sequence_len = static_cast<int>(sequence.size());
+            for (int length = max(min_length, 1); length <= min(max_length, sequence_len); ++length) {
+                for (int start = 0; start <= sequence_len - length; ++start) {
+                    fallback[string(reinterpret_cast<const char*>(sequence.data() + start), 
+                                    length * sizeof(TokenId))] += seq_data.weight;
+                }
+            }
+        }
+    }
+    
+    // Frequency descending, then token order, like the other engines
+    vector<PatternCount> get_frequent_patterns(int min_support, QueryProfile* profile = nullptr) const {
+        vector<PatternCount> patterns;
+        for_each_pattern(max(min_support, 1), nullptr, profile, 
+                         [&](const TokenId* tokens, size_t length, int count) {
+            patterns.emplace_back(vector<TokenId>(tokens, tokens + length), count, false);
+        });
+        
+        auto sort_start = high_resolution_clock::now();
+        sort(patterns.begin(), patterns.end(), [](const auto& a, const auto& b) {
+            if (get<1>(a) != get<1>(b)) return get<1>(a) > get<1>(b);
+            return get<0>(a) < get<0>(b);
+        });
+        if (profile) profile->sort_time += elapsed_ms(sort_start);
+        return patterns;
+    }
+    
+    vector<PatternCount> get_top_k_patterns(size_t k, int min_support, QueryProfile* profile = nullptr) const {
+        TopKCollector top_k(k, min_support);
+        for_each_pattern(max(min_support, 1), &top_k, profile, 
+                         [&](const TokenId* tokens, size_t length, int count) {
+            top_k.offer(tokens, length, count, false);
+        });
+        return top_k.take_sorted();
+    }
+    
+    size_t entry_count() const { return id_bits == 0 ? fallback.size() : narrow.size() + wide.size(); }
+    
+    size_t memory_bytes() const {
+        size_t bytes = narrow.memory_bytes() + wide.memory_bytes();
+        for (const auto& entry : fallback) bytes += entry.first.capacity() + sizeof(entry) + sizeof(void*);
+        return bytes;
+    }
+    
+    // e.g. "16-bit ids x 4 in 64-bit keys"
+    string shape_name() const {
+        if (id_bits == 0) return "hash map (shape does not pack)";
+        return to_string(id_bits) + "-bit ids x " + to_string(max_length) + " in " + 
+               (max_length * id_bits <= 64 ? "64" : "128") + "-bit keys";
+    }
+};
+
+// Pattern counting engine used by AdvancedSubsequenceMiner
+enum class MiningEngine {
+    Trie,            // incremental trie over windows and bitmask subsequences
+    PatternGrowth,   // PrefixSpan over the sequence database, per-sequence support
+    SuffixAutomaton, // contiguous patterns only, per-sequence support
+    VerticalBitmap,  // SPAM-style position bitmaps, per-sequence support
+    PackedNgram      // packed n-gram keys, contiguous patterns only, occurrence counts
+};
+
+// Command-line names for the engines
+const char* engine_name(MiningEngine engine) {
+    switch (engine) {
+        case MiningEngine::Trie: return "trie";
+        case MiningEngine::PatternGrowth: return "growth";
+        case MiningEngine::SuffixAutomaton: return "automaton";
+        case MiningEngine::VerticalBitmap: return "bitmap";
+        case MiningEngine::PackedNgram: return "ngram";
+    }
+    return "unknown";
+}
+
+bool parse_engine_name(const string& name, MiningEngine& engine) {
+    for (MiningEngine candidate : {MiningEngine::Trie, MiningEngine::PatternGrowth, 
+                                   MiningEngine::SuffixAutomaton, MiningEngine::VerticalBitmap, 
+                                   MiningEngine::PackedNgram}) {
+        if (name == engine_name(candidate)) {
+            engine = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+private:
+    const char* mapped;
+    size_t length;
+    string error;
+    
+public:
+    // advice is the madvise hint: sequential for parsing, random for index lookups
+    explicit MappedFile(const string& path, int advice = MADV_SEQUENTIAL) : mapped(nullptr), length(0) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            error = "cannot open " + path + ": " + strerror(errno);
+            return;
+        }
+        
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            error = "cannot stat " + path + ": " + strerror(errno);
+        } else if (info.st_size > 0) {
+            void* address = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address == MAP_FAILED) {
+                error = "cannot map " + path + ": " + strerror(errno);
+            } else {
+                mapped = static_cast<const char*>(address);
+                length = static_cast<size_t>(info.st_size);
+                madvise(address, length, advice);
+            }
+        }
+        close(fd);
+    }
+    
+    ~MappedFile() {
+        if (mapped) munmap(const_cast<char*>(mapped), length);
+    }
+    
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    bool is_open() const { return error.empty(); }
+    const string& get_error() const { return error; }
+    string_view contents() const { return string_view(mapped, length); }
+};
+
+// Tokens of one newline-aligned slice of an event log. Token text stays in the
+// mapped file; tokens get chunk-local IDs in first-appearance order so the
+// chunks can be interned into the shared SymbolTable in file order afterwards.
+struct ParsedChunk {
+    vector<string_view> local_symbols;
+    vector<uint32_t> tokens;     // local IDs, all sequences back to back
+    vector<size_t> sequence_ends;  // end offset in tokens of each sequence
+    
+    void parse(string_view text) {
+        unordered_map<string_view, uint32_t> local_ids;
+        size_t pos = 0;
+        
+        while (pos < text.size()) {
+            size_t line_end = text.find('\n', pos);
+            if (line_end == string_view::npos) line_end = text.size();
+            size_t sequence_start = tokens.size();
+            
+            while (pos < line_end) {
+                while (pos < line_end && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\r')) ++pos;
+                size_t token_start = pos;
+                while (pos < line_end && text[pos] != ' ' && text[pos] != '\t' && text[pos] != '\r') ++pos;
+                if (pos == token_start) continue;
+                
+                string_view token = text.substr(token_start, pos - token_start);
+                auto inserted = local_ids.emplace(token, static_cast<uint32_t>(local_symbols.size()));
+                if (inserted.second) local_symbols.push_back(token);
+                tokens.push_back(inserted.first->second);
+            }
+            
+            // Blank lines are skipped, as in interactive input
+            if (tokens.size() > sequence_start) sequence_ends.push_back(tokens.size());
+            pos = line_end + 1;
+        }
+    }
+};
+
+// Result of a bulk file ingestion
+struct IngestStatistics {
+    bool success;
+    string error;
+    size_t bytes;
+    size_t sequences;
+    size_t tokens;
+    double parse_time;  // ms, mapping + tokenizing + interning
+    double index_time;  // ms, add to the database and index
+    
+    IngestStatistics() : success(false), bytes(0), sequences(0), tokens(0), 
+                        parse_time(0.0), index_time(0.0) {}
+    
+    double parse_throughput() const {  // MB/s
+        return parse_time > 0.0 ? (bytes / 1048576.0) / (parse_time / 1000.0) : 0.0;
+    }
+    
+    double total_throughput() const {  // MB/s
+        double total = parse_time + index_time;
+        return total > 0.0 ? (bytes / 1048576.0) / (total / 1000.0) : 0.0;
+    }
+};
+
+// Read-only view of an index snapshot. Sections are used straight from the
+// mapping, so opening costs one mmap and a few header checks, and processes
+// that open the same file share its pages through the page cache. Section
+// bounds are checked on open; the contents themselves are trusted.
+class IndexSnapshot {
+private:
+    static constexpr NodeIndex ROOT = 0;
+    
+    MappedFile file;
+    string error;
+    const SnapshotHeader* header;
+    const SnapshotNode* nodes;
+    const TrieEdge* edges;
+    const uint8_t* postings;
+    const uint64_t* symbol_offsets;
+    const char* symbol_text;
+    const TokenId* symbol_order;
+    const int32_t* sequence_ids;
+    const uint64_t* sequence_offsets;
+    const TokenId* sequence_tokens;
+    
+    template <typename T>
+    const T* section(uint64_t offset, uint64_t count) {
+        string_view data = file.contents();
+        if (offset % alignof(T) != 0 || offset > data.size() || 
+            count > (data.size() - offset) / sizeof(T)) {
+            if (error.empty()) error = "truncated or misaligned snapshot section";
+            return nullptr;
+        }
+        return reinterpret_cast<const T*>(data.data() + offset);
+    }
+    
+    bool map_sections() {
+        string_view data = file.contents();
+        if (data.size() < sizeof(SnapshotHeader)) {
+            error = "not a snapshot (file too small)";
+            return false;
+        }
+        header = reinterpret_cast<const SnapshotHeader*>(data.data());
+        if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+            error = "not a snapshot (bad magic)";
+            return false;
+        }
+        if (header->format_version != SNAPSHOT_VERSION || header->header_bytes != sizeof(SnapshotHeader)) {
+            error = "unsupported snapshot version " + to_string(header->format_version);
+            return false;
+        }
+        if (header->file_bytes != data.size() || header->node_count == 0) {
+            error = "snapshot size does not match its header";
+            return false;
+        }
+        
+        nodes = section<SnapshotNode>(header->nodes_offset, header->node_count);
+        edges = section<TrieEdge>(header->edges_offset, header->edge_count);
+        postings = section<uint8_t>(header->postings_offset, header->posting_bytes);
+        symbol_offsets = section<uint64_t>(header->symbol_offsets_offset, header->symbol_count + 1);
+        symbol_text = section<char>(header->symbol_text_offset, header->symbol_bytes);
+        symbol_order = section<TokenId>(header->symbol_order_offset, header->symbol_count);
+        sequence_ids = section<int32_t>(header->sequence_ids_offset, header->sequence_count);
+        sequence_offsets = section<uint64_t>(header->sequence_offsets_offset, header->sequence_count + 1);
+        sequence_tokens = section<TokenId>(header->sequence_tokens_offset, header->token_count);
+        if (!error.empty()) return false;
+        
+        if (symbol_offsets[header->symbol_count] > header->symbol_bytes || 
+            sequence_offsets[header->sequence_count] > header->token_count) {
+            error = "snapshot offsets out of range";
+            return false;
+        }
+        return true;
+    }
+    
+    NodeIndex find_node(const vector<string>& pattern) const {
+        NodeIndex node = ROOT;
+        for (const string& token_text : pattern) {
+            TokenId token;
+            if (!find_symbol(token_text, token)) return INVALID_NODE;
+            
+            const TrieEdge* first = edges + nodes[node].edge_begin;
+            const TrieEdge* last = first + nodes[node].edge_count;
+            const TrieEdge* it = lower_bound(first, last, token, 
+                                             [](const TrieEdge& e, TokenId t) { return e.token < t; });
+            if (it == last || it->token != token) return INVALID_NODE;
+            node = it->child;
+        }
+        return node;
+    }
+    
+    // Same traversal and pruning as SubsequenceTrie::collect_patterns
+    void collect(NodeIndex node, int min_frequency, bool noncontiguous_only, vector<TokenId>& current, 
+                 vector<PatternCount>& patterns, TopKCollector* top_k) const {
+        const SnapshotNode& n = nodes[node];
+        if (n.is_end_of_pattern && n.frequency >= min_frequency && 
+            (!noncontiguous_only || n.noncontiguous_frequency > 0)) {
+            if (top_k) {
+                top_k->offer(current, n.frequency, n.noncontiguous_frequency > 0);
+            } else {
+                patterns.emplace_back(current, n.frequency, n.noncontiguous_frequency > 0);
+            }
+        }
+        
+        for (uint32_t i = 0; i < n.edge_count; ++i) {
+            const TrieEdge& edge = edges[n.edge_begin + i];
+            int threshold = top_k ? top_k->threshold() : min_frequency;
+            if (nodes[edge.child].subtree_max_frequency < threshold) continue;
+            current.push_back(edge.token);
+            collect(edge.child, min_frequency, noncontiguous_only, current, patterns, top_k);
+            current.pop_back();
+        }
+    }
+    
+    PatternInfo make_pattern_info(const vector<TokenId>& tokens, int frequency, bool is_noncontiguous) const {
+        vector<string> pattern;
+        string pattern_string;
+        for (TokenId token : tokens) {
+            if (!pattern.empty()) pattern_string += " -> ";
+            pattern.emplace_back(symbol(token));
+            pattern_string += pattern.back();
+        }
+        double support = header->sequence_count == 0 ? 0.0 : 
+                         static_cast<double>(frequency) / header->sequence_count;
+        return PatternInfo(pattern, frequency, static_cast<int>(tokens.size()), support, pattern_string, 
+                           is_noncontiguous, is_noncontiguous ? "Non-contiguous" : "Contiguous");
+    }
+    
+    vector<PatternInfo> to_pattern_infos(const vector<PatternCount>& pattern_counts) const {
+        vector<PatternInfo> result;
+        result.reserve(pattern_counts.size());
+        for (const auto& p : pattern_counts) {
+            result.push_back(make_pattern_info(get<0>(p), get<1>(p), get<2>(p)));
+        }
+        return result;
+    }
+    
+public:
+    explicit IndexSnapshot(const string& path)
+        : file(path, MADV_RANDOM), header(nullptr), nodes(nullptr), edges(nullptr), postings(nullptr), 
+          symbol_offsets(nullptr), symbol_text(nullptr), symbol_order(nullptr), sequence_ids(nullptr), 
+          sequence_offsets(nullptr), sequence_tokens(nullptr) {
+        if (!file.is_open()) {
+            error = file.get_error();
+        } else {
+            map_sections();
+        }
+    }
+    
+    bool is_open() const { return error.empty(); }
+    const string& get_error() const { return error; }
+    const SnapshotHeader& get_header() const { return *header; }
+    
+    string_view symbol(TokenId id) const {
+        return string_view(symbol_text + symbol_offsets[id], symbol_offsets[id + 1] - symbol_offsets[id]);
+    }
+    
+    // Binary search over the ids sorted by text
+    bool find_symbol(string_view text, TokenId& id) const {
+        const TokenId* last = symbol_order + header->symbol_count;
+        const TokenId* it = lower_bound(symbol_order, last, text, 
+                                        [this](TokenId a, string_view t) { return symbol(a) < t; });
+        if (it == last || symbol(*it) != text) return false;
+        id = *it;
+        return true;
+    }
+    
+    size_t sequence_count() const { return header->sequence_count; }
+    int sequence_id(size_t i) const { return sequence_ids[i]; }
+    const TokenId* sequence_begin(size_t i) const { return sequence_tokens + sequence_offsets[i]; }
+    size_t sequence_length(size_t i) const { return sequence_offsets[i + 1] - sequence_offsets[i]; }
+    
+    const SnapshotNode* node_data() const { return nodes; }
+    const TrieEdge* edge_data() const { return edges; }
+    const uint8_t* posting_data() const { return postings; }
+    
+    // Frequency 0 when the pattern is not in the index
+    PatternInfo search_pattern(const vector<string>& pattern) const {
+        NodeIndex node = find_node(pattern);
+        if (node == INVALID_NODE || !nodes[node].is_end_of_pattern) {
+            return PatternInfo(pattern, 0, static_cast<int>(pattern.size()), 0.0, "", false, "");
+        }
+        vector<TokenId> tokens;
+        TokenId token;
+        for (const string& text : pattern) {
+            find_symbol(text, token);
+            tokens.push_back(token);
+        }
+        return make_pattern_info(tokens, nodes[node].frequency, nodes[node].noncontiguous_frequency > 0);
+    }
+    
+    vector<Position> get_positions(const vector<string>& pattern) const {
+        vector<Position> positions;
+        NodeIndex node = find_node(pattern);
+        if (node == INVALID_NODE) return positions;
+        
+        const uint8_t* cursor = postings + nodes[node].posting_offset;
+        PostingStore::decode_entries([&]() { return *cursor++; }, nodes[node].posting_count, 
+                                     [&](int sequence_id, int position) {
+            positions.emplace_back(sequence_id, position);
+        });
+        return positions;
+    }
+    
+    // Same results and order as AdvancedSubsequenceMiner with the Trie engine
+    vector<PatternInfo> get_frequent_patterns(int min_support, bool noncontiguous_only = false) const {
+        vector<PatternCount> patterns;
+        vector<TokenId> current;
+        collect(ROOT, max(min_support, 1), noncontiguous_only, current, patterns, nullptr);
+        stable_sort(patterns.begin(), patterns.end(), 
+                    [](const auto& a, const auto& b) { return get<1>(a) > get<1>(b); });
+        return to_pattern_infos(patterns);
+    }
+    
+    vector<PatternInfo> get_top_k_patterns(size_t k, int min_support, bool noncontiguous_only = false) const {
+        TopKCollector top_k(k, max(min_support, 1));
+        vector<PatternCount> unused;
+        vector<TokenId> current;
+        collect(ROOT, max(min_support, 1), noncontiguous_only, current, unused, &top_k);
+        return to_pattern_infos(top_k.take_sorted());
+    }
+};
+
+// Trie maintenance work; times are summed over worker threads
+struct IndexProfile {
+    double generation_time = 0.0;   // ms enumerating subsequences
+    double insertion_time = 0.0;    // ms inserting into (or withdrawing from) tries
+    double merge_time = 0.0;        // ms merging worker shards
+    long long subsequences = 0;     // occurrences generated
+    long long passes = 0;           // sequences enumerated
+    long long folded_copies = 0;    // further copies counted by weight within a pass
+    
+    void add(const IndexProfile& other) {
+        generation_time += other.generation_time;
+        insertion_time += other.insertion_time;
+        merge_time += other.merge_time;
+        subsequences += other.subsequences;
+        passes += other.passes;
+        folded_copies += other.folded_copies;
+    }
+};
+
+// Mining statistics
+struct MiningStatistics {
+    int total_sequences;
+    int total_patterns_found;
+    double mining_time;
+    int cache_hits;     // queries answered from the result cache
+    int cache_misses;   // queries that had to mine
+    
+    // Since the trie was last rebuilt
+    IndexProfile indexing;
+    
+    // Phases of the last mine_frequent_patterns / find_top_k_patterns call (ms)
+    string engine;
+    double index_refresh_time;       // lazy automaton / bitmap rebuild
+    double extraction_time;          // engine traversal, excluding its sort
+    double sort_time;
+    double pattern_info_time;        // decoding tokens into PatternInfo
+    long long candidates_generated;  // patterns whose support was checked
+    long long candidates_kept;       // patterns returned
+    
+    // Index shape, filled in by get_mining_statistics
+    size_t node_count;     // trie nodes or automaton states
+    size_t edge_count;
+    size_t index_bytes;    // engine index, excluding the sequence database
+    
+    // Deduplication, filled in by get_mining_statistics
+    int distinct_sequences;    // entries in the sequence database
+    double dedup_saved_time;   // estimated ms of indexing avoided by weighting copies
+    
+    MiningStatistics() : total_sequences(0), total_patterns_found(0), 
+                        mining_time(0.0), cache_hits(0), cache_misses(0), engine("trie"), index_refresh_time(0.0), 
+                        extraction_time(0.0), sort_time(0.0), pattern_info_time(0.0), 
+                        candidates_generated(0), candidates_kept(0), node_count(0), edge_count(0), 
+                        index_bytes(0), distinct_sequences(0), dedup_saved_time(0.0) {}
+    
+    double dedup_ratio() const {
+        return distinct_sequences == 0 ? 1.0 : static_cast<double>(total_sequences) / distinct_sequences;
+    }
+    
+    string to_json() const {
+        ostringstream json;
+        json << fixed << setprecision(4) << "{"
+             << "\"engine\":\"" << engine << "\","
+             << "\"total_sequences\":" << total_sequences << ","
+             << "\"total_patterns_found\":" << total_patterns_found << ","
+             << "\"cache_hits\":" << cache_hits << ","
+             << "\"cache_misses\":" << cache_misses << ","
+             << "\"indexing\":{"
+             << "\"generation_ms\":" << indexing.generation_time << ","
+             << "\"insertion_ms\":" << indexing.insertion_time << ","
+             << "\"merge_ms\":" << indexing.merge_time << ","
+             << "\"subsequences\":" << indexing.subsequences << "},"
+             << "\"query\":{"
+             << "\"total_ms\":" << mining_time << ","
+             << "\"index_refresh_ms\":" << index_refresh_time << ","
+             << "\"extraction_ms\":" << extraction_time << ","
+             << "\"sort_ms\":" << sort_time << ","
+             << "\"pattern_info_ms\":" << pattern_info_time << ","
+             << "\"candidates_generated\":" << candidates_generated << ","
+             << "\"candidates_kept\":" << candidates_kept << "},"
+             << "\"index\":{"
+             << "\"nodes\":" << node_count << ","
+             << "\"edges\":" << edge_count << ","
+             << "\"bytes\":" << index_bytes << "},"
+             << "\"dedup\":{"
+             << "\"distinct_sequences\":" << distinct_sequences << ","
+             << "\"ratio\":" << dedup_ratio() << ","
+             << "\"saved_ms\":" << dedup_saved_time << "}}";
+        return json.str();
+    }
+};
+
+// Appends text to out with JSON string escapes (no surrounding quotes)
+void append_json_escaped(string& out, string_view text) {
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            out += code;
+        } else {
+            out += c;
+        }
+    }
+}
+
+// One mined pattern as a result sink sees it. Tokens are spelled from the
+// symbol table on demand; the view is only valid during the sink call.
+struct PatternView {
+    const TokenId* tokens;
+    size_t length;
+    int frequency;
+    bool is_noncontiguous;
+    const SymbolTable* symbols;
+    
+    string_view token(size_t i) const { return symbols->decode(tokens[i]); }
+};
+
+enum class ResultFormat {
+    Csv,    // pattern,length,frequency,support,type with a header row
+    Jsonl   // one JSON object per pattern
+};
+
+bool parse_result_format(const string& name, ResultFormat& format) {
+    if (name == "csv") format = ResultFormat::Csv;
+    else if (name == "jsonl") format = ResultFormat::Jsonl;
+    else return false;
+    return true;
+}
+
+// Result sink that renders each pattern as a CSV row or JSON line directly into
+// a block buffer, and hands full blocks to write(2). A result of any size is
+// exported with no allocation per pattern. "-" writes to stdout.
+class PatternWriter {
+private:
+    int fd;
+    bool owns_fd;
+    ResultFormat format;
+    size_t sequence_count;  // support denominator
+    size_t block_bytes;
+    string buffer;
+    long long rows;
+    string error;
+    
+    void append_integer(long long value) {
+        char digits[24];
+        int length = snprintf(digits, sizeof(digits), "%lld", value);
+        buffer.append(digits, static_cast<size_t>(length));
+    }
+    
+    void append_support(double value) {
+        char digits[32];
+        int length = snprintf(digits, sizeof(digits), "%.6f", value);
+        buffer.append(digits, static_cast<size_t>(length));
+    }
+    
+public:
+    PatternWriter(const string& path, ResultFormat f, size_t sequences, size_t block = 1 << 20)
+        : fd(-1), owns_fd(path != "-"), format(f), sequence_count(sequences), 
+          block_bytes(max<size_t>(block, 4096)), rows(0) {
+        fd = owns_fd ? open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) : STDOUT_FILENO;
+        if (fd < 0) {
+            error = "cannot open " + path + ": " + strerror(errno);
+            return;
+        }
+        buffer.reserve(block_bytes + 4096);
+        if (format == ResultFormat::Csv) buffer += "pattern,length,frequency,support,type\n";
+    }
+    
+    ~PatternWriter() {
+        flush();
+        if (owns_fd && fd >= 0) close(fd);
+    }
+    
+    PatternWriter(const PatternWriter&) = delete;
+    PatternWriter& operator=(const PatternWriter&) = delete;
+    
+    bool is_open() const { return fd >= 0; }
+    const string& get_error() const { return error; }
+    long long row_count() const { return rows; }
+    
+    void operator()(const PatternView& pattern) {
+        if (fd < 0) return;
+        double support = sequence_count == 0 ? 0.0 : static_cast<double>(pattern.frequency) / sequence_count;
+        
+        if (format == ResultFormat::Csv) {
+            // The pattern field is always quoted, with embedded quotes doubled
+            buffer += '"';
+            for (size_t i = 0; i < pattern.length; ++i) {
+                if (i > 0) buffer += " -> ";
+                for (char c : pattern.token(i)) {
+                    if (c == '"') buffer += '"';
+                    buffer += c;
+                }
+            }
+            buffer += "\",";
+            append_integer(static_cast<long long>(pattern.length));
+            buffer += ',';
+            append_integer(pattern.frequency);
+            buffer += ',';
+            append_support(support);
+            buffer += pattern.is_noncontiguous ? ",non-contiguous\n" : ",contiguous\n";
+        } else {
+            buffer += "{\"pattern\":[";
+            for (size_t i = 0; i < pattern.length; ++i) {
+                if (i > 0) buffer += ',';
+                buffer += '"';
+                append_json_escaped(buffer, pattern.token(i));
+                buffer += '"';
+            }
+            buffer += "],\"length\":";
+            append_integer(static_cast<long long>(pattern.length));
+            buffer += ",\"frequency\":";
+            append_integer(pattern.frequency);
+            buffer += ",\"support\":";
+            append_support(support);
+            buffer += pattern.is_noncontiguous ? ",\"noncontiguous\":true}\n" : ",\"noncontiguous\":false}\n";
+        }
+        rows++;
+        
+        if (buffer.size() >= block_bytes) flush();
+    }
+    
+    // Writes out the buffered block; false once a write has failed
+    bool flush() {
+        if (fd < 0 || !error.empty()) return false;
+        size_t written = 0;
+        while (written < buffer.size()) {
+            ssize_t n = write(fd, buffer.data() + written, buffer.size() - written);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                error = string("write failed: ") + strerror(errno);
+                return false;
+            }
+            written += static_cast<size_t>(n);
+        }
+        buffer.clear();
+        return true;
+    }
+};
+
+// z such that a standard normal falls below it with probability p, by bisection
+double normal_quantile(double p) {
+    double low = -10.0, high = 10.0;
+    for (int i = 0; i < 100; ++i) {
+        double mid = (low + high) / 2;
+        if (0.5 * erfc(-mid / sqrt(2.0)) < p) low = mid;
+        else high = mid;
+    }
+    return (low + high) / 2;
+}
+
+// Approximate mining settings. Each round draws sequences uniformly (with
+// replacement) until the sample doubles, then mines it; refinement stops once
+// the accuracy target is met or the next round would overrun the time budget.
+struct SamplingOptions {
+    size_t initial_sample = 10000;  // sequences drawn for the first round
+    double time_budget_ms = 1000.0; // <= 0 runs a single round
+    double target_error = 0.05;     // half-width / estimate to reach; <= 0 refines until the budget
+    double confidence = 0.95;       // two-sided level of the intervals
+    uint64_t seed = 42;
+};
+
+// A pattern's frequency over the whole database, estimated from a sample,
+// with a confidence interval; support is frequency over the sequence count
+struct SampledPatternEstimate {
+    vector<string> pattern;
+    string pattern_string;
+    double frequency;
+    double lower;
+    double upper;
+    double support;
+    bool is_noncontiguous;
+    
+    SampledPatternEstimate(vector<string> p, string p_str, double freq, double low, double high, 
+                           double sup, bool non_contig)
+        : pattern(move(p)), pattern_string(move(p_str)), frequency(freq), lower(low), upper(high), 
+          support(sup), is_noncontiguous(non_contig) {}
+};
+
+struct SampledMiningResult {
+    vector<SampledPatternEstimate> patterns;  // ranked by estimated frequency
+    size_t population = 0;       // sequences in the database
+    size_t sample_size = 0;      // draws mined in the last round
+    int rounds = 0;
+    int sample_min_support = 0;  // lowered threshold applied to the last sample
+    double relative_error = 0.0; // widest half-width / estimate among the patterns
+    bool exact = false;          // the sample reached the database size, so it was mined in full
+    bool target_met = false;
+    double elapsed_ms = 0.0;
+};
+
+// Main Advanced Subsequence Miner class
+class AdvancedSubsequenceMiner {
+private:
+    int min_length;
+    int max_length;
+    SymbolTable symbols;
+    SubsequenceTrie trie;
+    vector<SequenceData> sequence_database;
+    unordered_map<int, size_t> sequence_index;  // sequence id -> slot in sequence_database
+    deque<int> arrival_order;                    // ids in insertion order, for expiry
+    int next_sequence_id;
+    int num_threads;
+    bool track_positions;  // keep posting lists in the trie (off saves memory)
+    
+    // With deduplication a slot holds one distinct sequence, weighted by its live
+    // copies; its id is that of the copy that created it, and the trie records
+    // positions under that id only. sequence_index maps every copy to the slot.
+    bool deduplicate;
+    unordered_multimap<uint64_t, size_t> content_index;  // sequence hash -> slot
+    unordered_map<int, vector<int>> group_members;       // slot id -> live copy ids
+    GapConstraints gap_constraints;  // applied to the trie's candidate generation
+    MiningEngine engine;
+    SuffixAutomaton automaton;
+    VerticalBitmapIndex bitmap_index;
+    PackedNgramIndex ngram_index;
+    bool engine_index_stale;  // automaton / bitmaps / n-grams need rebuilding after data changes
+    
+    // Lowest-threshold mine_frequent_patterns result per engine, max_length and
+    // type filter. Results rank by frequency, so any higher threshold or top-k
+    // query is answered by a prefix, filtered for non-contiguous if asked.
+    struct CachedPatterns {
+        uint64_t dataset_version;
+        int min_support;
+        vector<PatternInfo> patterns;
+    };
+    unordered_map<string, CachedPatterns> pattern_cache;
+    uint64_t dataset_version;  // bumped whenever sequences are added or removed
+    bool cache_results;
+    MiningStatistics statistics;
+    
+    struct GeneratedSubsequence {
+        uint32_t offset;  // into the generation buffer
+        uint32_t length;
+        int start;
+        bool is_noncontiguous;
+    };
+    
+    // Adds (remove == false) or withdraws (remove == true) weight copies of one
+    // sequence's subsequences; positions go under seq_id unless it is negative.
+    // Only reads miner settings, so workers may call it concurrently on private tries.
+    // Subsequences are buffered first so generation and insertion are timed apart.
+    void generate_subsequences(SubsequenceTrie& target, const vector<TokenId>& sequence, 
+                               int seq_id, IndexProfile& profile, int weight = 1, 
+                               bool remove = false) const {
+        thread_local vector<TokenId> buffer;
+        thread_local vector<GeneratedSubsequence> generated;
+        buffer.clear();
+        generated.clear();
+        
+        auto start_time = high_resolution_clock::now();
+        for_each_subsequence(sequence, min_length, max_length, 
+                             [&](const TokenId* tokens, size_t length, int start, bool is_noncontiguous) {
+            generated.push_back({static_cast<uint32_t>(buffer.size()), static_cast<uint32_t>(length), 
+                                 start, is_noncontiguous});
+            buffer.insert(buffer.end(), tokens, tokens + length);
+        }, gap_constraints);
+        auto generated_time = high_resolution_clock::now();
+        
+        for (const GeneratedSubsequence& g : generated) {
+            if (remove) {
+                target.remove_pattern(buffer.data() + g.offset, g.length, g.is_noncontiguous, weight);
+            } else {
+                target.insert_pattern(buffer.data() + g.offset, g.length, seq_id, g.start, 
+                                      g.is_noncontiguous, weight);
+            }
+        }
+        
+        profile.generation_time += elapsed_ms(start_time, generated_time);
+        profile.insertion_time += elapsed_ms(generated_time);
+        profile.subsequences += static_cast<long long>(generated.size());
+        profile.passes++;
+        profile.folded_copies += weight - 1;
+    }
+    
+    static uint64_t hash_sequence(const vector<TokenId>& sequence) {
+        uint64_t hash = 0x9E3779B97F4A7C15ull ^ sequence.size();
+        for (TokenId token : sequence) {
+            hash = (hash ^ token) * 0xFF51AFD7ED558CCDull;
+            hash ^= hash >> 32;
+        }
+        return hash;
+    }
+    
+    // Files a new copy under sequence_id: a new slot, or with deduplication one
+    // more unit of weight on the slot already holding the same tokens. Returns
+    // true for a new slot. Does not touch the index.
+    bool place_sequence(int sequence_id, vector<TokenId> sequence) {
+        if (deduplicate) {
+            uint64_t hash = hash_sequence(sequence);
+            auto range = content_index.equal_range(hash);
+            for (auto it = range.first; it != range.second; ++it) {
+                SequenceData& existing = sequence_database[it->second];
+                if (existing.sequence != sequence) continue;
+                existing.weight++;
+                sequence_index[sequence_id] = it->second;
+                group_members[existing.id].push_back(sequence_id);
+                return false;
+            }
+            content_index.emplace(hash, sequence_database.size());
+            group_members[sequence_id].push_back(sequence_id);
+        }
+        sequence_index[sequence_id] = sequence_database.size();
+        sequence_database.emplace_back(sequence_id, move(sequence));
+        return true;
+    }
+    
+    // Re-files the live copies in arrival order, after deduplication is switched
+    void regroup_sequences() {
+        vector<pair<int, vector<TokenId>>> copies;
+        copies.reserve(sequence_index.size());
+        unordered_set<int> seen;
+        for (int sequence_id : arrival_order) {
+            auto it = sequence_index.find(sequence_id);
+            if (it == sequence_index.end() || !seen.insert(sequence_id).second) continue;
+            copies.emplace_back(sequence_id, sequence_database[it->second].sequence);
+        }
+        
+        sequence_database.clear();
+        sequence_index.clear();
+        content_index.clear();
+        group_members.clear();
+        for (auto& copy : copies) place_sequence(copy.first, move(copy.second));
+    }
+    
+    // Moves the last slot into slot, which is being dropped, keeping the
+    // id and content maps pointing at it
+    void drop_slot(size_t slot) {
+        size_t last = sequence_database.size() - 1;
+        if (deduplicate) {
+            auto unlink = [this](size_t from, size_t to) {
+                auto range = content_index.equal_range(hash_sequence(sequence_database[from].sequence));
+                for (auto it = range.first; it != range.second; ++it) {
+                    if (it->second != from) continue;
+                    if (to == from) content_index.erase(it);
+                    else it->second = to;
+                    return;
+                }
+            };
+            unlink(slot, slot);
+            if (slot != last) unlink(last, slot);
+            group_members.erase(sequence_database[slot].id);
+        }
+        
+        // Swap with the last slot so removal does not shift the database
+        if (slot != last) {
+            sequence_database[slot] = move(sequence_database.back());
+            if (deduplicate) {
+                for (int member : group_members[sequence_database[slot].id]) sequence_index[member] = slot;
+            } else {
+                sequence_index[sequence_database[slot].id] = slot;
+            }
+        }
+        sequence_database.pop_back();
+    }
+    
+    // Indexes database[first, last) into target on num_threads workers. Each worker
+    // fills a private shard, pulling small chunks from a shared counter so long
+    // sequences do not stall one thread; shards are then merged pairwise.
+    void index_sequences(SubsequenceTrie& target, const vector<SequenceData>& database, 
+                         size_t first, size_t last, IndexProfile& indexing) const {
+        size_t count = last - first;
+        size_t workers = min(static_cast<size_t>(max(num_threads, 1)), count);
+        bool positions = target.is_tracking_positions();
+        
+        if (workers <= 1) {
+            for (size_t i = first; i < last; ++i) {
+                generate_subsequences(target, database[i].sequence, database[i].id, indexing, 
+                                      database[i].weight);
+            }
+            return;
+        }
+        
+        vector<SubsequenceTrie> shards(workers, SubsequenceTrie(positions));
+        vector<IndexProfile> profiles(workers);
+        atomic<size_t> next_chunk(first);
+        size_t chunk_size = max<size_t>(1, count / (workers * 16));
+        
+        vector<thread> pool;
+        for (size_t w = 0; w < workers; ++w) {
+            pool.emplace_back([&, w]() {
+                while (true) {
+                    size_t begin = next_chunk.fetch_add(chunk_size);
+                    if (begin >= last) break;
+                    size_t end = min(last, begin + chunk_size);
+                    for (size_t i = begin; i < end; ++i) {
+                        generate_subsequences(shards[w], database[i].sequence, database[i].id, 
+                                              profiles[w], database[i].weight);
+                    }
+                }
+            });
+        }
+        for (auto& worker : pool) worker.join();
+        for (const IndexProfile& profile : profiles) indexing.add(profile);
+        
+        auto merge_start = high_resolution_clock::now();
+        for (size_t step = 1; step < workers; step *= 2) {
+            vector<thread> mergers;
+            for (size_t i = 0; i + step < workers; i += 2 * step) {
+                mergers.emplace_back([&shards, i, step, positions]() {
+                    shards[i].merge_from(shards[i + step]);
+                    shards[i + step] = SubsequenceTrie(positions);
+                });
+            }
+            for (auto& merger : mergers) merger.join();
+        }
+        
+        target.merge_from(shards[0]);
+        indexing.merge_time += elapsed_ms(merge_start);
+    }
+    
+    void mark_dataset_changed() {
+        engine_index_stale = true;
+        dataset_version++;
+        pattern_cache.clear();
+    }
+    
+    string cache_key(bool noncontiguous_only, PatternClosure closure) const {
+        return string(engine_name(engine)) + "|" + to_string(max_length) + "|" + 
+               (noncontiguous_only ? "n" : "b") + "|" + closure_name(closure);
+    }
+    
+    // Fills result with the first limit cached patterns that meet min_support.
+    // Whether a pattern is maximal depends on min_support, so maximal results
+    // are only reused for the same min_support.
+    bool lookup_cached(int min_support, bool noncontiguous_only, PatternClosure closure, size_t limit, 
+                       vector<PatternInfo>& result) {
+        if (!cache_results) return false;
+        
+        // A non-contiguous query can also be filtered out of the unfiltered result
+        vector<bool> filters = {noncontiguous_only};
+        if (noncontiguous_only) filters.push_back(false);
+        
+        for (bool filter : filters) {
+            auto it = pattern_cache.find(cache_key(filter, closure));
+            if (it == pattern_cache.end() || it->second.dataset_version != dataset_version || 
+                it->second.min_support > min_support || 
+                (closure == PatternClosure::Maximal && it->second.min_support != min_support)) {
+                continue;
+            }
+            
+            result.clear();
+            for (const PatternInfo& pattern : it->second.patterns) {
+                if (pattern.frequency < min_support || result.size() >= limit) break;
+                if (noncontiguous_only && !pattern.is_noncontiguous) continue;
+                result.push_back(pattern);
+            }
+            statistics.cache_hits++;
+            return true;
+        }
+        
+        statistics.cache_misses++;
+        return false;
+    }
+    
+    void store_cached(int min_support, bool noncontiguous_only, PatternClosure closure, 
+                      const vector<PatternInfo>& patterns) {
+        if (!cache_results) return;
+        
+        string key = cache_key(noncontiguous_only, closure);
+        auto it = pattern_cache.find(key);
+        if (it != pattern_cache.end() && it->second.dataset_version == dataset_version && 
+            it->second.min_support <= min_support && closure != PatternClosure::Maximal) {
+            return;
+        }
+        pattern_cache[key] = CachedPatterns{dataset_version, min_support, patterns};
+    }
+    
+    // The engine's full result for mine_frequent_patterns, ranked
+    vector<PatternCount> extract_frequent_patterns(int min_support, bool noncontiguous_only, 
+                                                   PatternClosure closure, QueryProfile& profile) {
+        vector<PatternCount> frequent_patterns;
+        if (engine == MiningEngine::PatternGrowth) {
+            PrefixSpanMiner prefix_span(sequence_database, symbols.size(), min_length, max_length);
+            frequent_patterns = prefix_span.mine(min_support, closure, &profile);
+        } else if (engine == MiningEngine::SuffixAutomaton) {
+            if (!noncontiguous_only) {
+                frequent_patterns = automaton.get_frequent_patterns(sequence_database, min_support, 
+                                                                    min_length, max_length, &profile);
+                filter_by_closure(frequent_patterns, closure, true);
+            }
+        } else if (engine == MiningEngine::VerticalBitmap) {
+            frequent_patterns = filtered_bitmap_patterns(min_support, noncontiguous_only, closure, &profile);
+        } else if (engine == MiningEngine::PackedNgram) {
+            if (!noncontiguous_only) {
+                frequent_patterns = ngram_index.get_frequent_patterns(min_support, &profile);
+                filter_by_closure(frequent_patterns, closure, true);
+            }
+        } else {
+            frequent_patterns = trie.get_frequent_patterns(min_support, noncontiguous_only, closure, &profile);
+        }
+        return frequent_patterns;
+    }
+    
+    // Closure is judged over both kinds of pattern before noncontiguous_only applies
+    vector<PatternCount> filtered_bitmap_patterns(int min_support, bool noncontiguous_only, 
+                                                  PatternClosure closure, QueryProfile* profile) const {
+        vector<PatternCount> patterns = bitmap_index.get_frequent_patterns(
+            min_support, min_length, max_length, noncontiguous_only && closure == PatternClosure::All, 
+            nullptr, profile);
+        filter_by_closure(patterns, closure, false);
+        if (noncontiguous_only && closure != PatternClosure::All) {
+            patterns.erase(remove_if(patterns.begin(), patterns.end(), 
+                                     [](const PatternCount& p) { return !get<2>(p); }), 
+                           patterns.end());
+        }
+        return patterns;
+    }
+    
+    // The engine's ranked result over a sample, limited to the first limit patterns
+    // (all of them when limit is unbounded). Indexes are built for the sample
+    // alone, so the miner's own are left untouched; closure is not applied.
+    vector<PatternCount> mine_sample(const vector<SequenceData>& sample, size_t limit, int min_support, 
+                                     bool noncontiguous_only, QueryProfile& profile) const {
+        bool all = limit == numeric_limits<size_t>::max();
+        if (engine == MiningEngine::PatternGrowth) {
+            PrefixSpanMiner prefix_span(sample, symbols.size(), min_length, max_length);
+            return all ? prefix_span.mine(min_support, PatternClosure::All, &profile) 
+                       : prefix_span.mine_top_k(limit, min_support, PatternClosure::All, &profile);
+        } else if (engine == MiningEngine::SuffixAutomaton) {
+            if (noncontiguous_only) return {};
+            SuffixAutomaton sample_automaton;
+            sample_automaton.build(sample);
+            return all ? sample_automaton.get_frequent_patterns(sample, min_support, min_length, max_length, &profile) 
+                       : sample_automaton.get_top_k_patterns(sample, limit, min_support, min_length, max_length, 
+                                                             &profile);
+        } else if (engine == MiningEngine::VerticalBitmap) {
+            VerticalBitmapIndex sample_bitmaps;
+            sample_bitmaps.build(sample, symbols.size());
+            if (all) {
+                return sample_bitmaps.get_frequent_patterns(min_support, min_length, max_length, 
+                                                            noncontiguous_only, nullptr, &profile);
+            }
+            TopKCollector top_k(limit, min_support);
+            return sample_bitmaps.get_frequent_patterns(min_support, min_length, max_length, 
+                                                        noncontiguous_only, &top_k, &profile);
+        } else if (engine == MiningEngine::PackedNgram) {
+            if (noncontiguous_only) return {};
+            PackedNgramIndex sample_ngrams;
+            sample_ngrams.build(sample, symbols.size(), min_length, max_length, num_threads);
+            return all ? sample_ngrams.get_frequent_patterns(min_support, &profile) 
+                       : sample_ngrams.get_top_k_patterns(limit, min_support, &profile);
+        }
+        
+        SubsequenceTrie sample_trie(false);
+        IndexProfile indexing;
+        index_sequences(sample_trie, sample, 0, sample.size(), indexing);
+        return all ? sample_trie.get_frequent_patterns(min_support, noncontiguous_only, PatternClosure::All, &profile) 
+                   : sample_trie.get_top_k_patterns(limit, min_support, noncontiguous_only, PatternClosure::All, 
+                                                    &profile);
+    }
+    
+    // Each pattern's count per sample sequence, summed by weight, and squared and
+    // summed by weight. Trie and PackedNgram count occurrences, so their per-draw
+    // variance has to be measured: a pattern can repeat many times within one
+    // sequence. The other engines count a sequence once if it contains the pattern
+    // (contiguously for SuffixAutomaton, as a subsequence otherwise).
+    vector<pair<double, double>> sample_count_moments(const vector<SequenceData>& sample, 
+                                                      const vector<PatternCount>& patterns) const {
+        vector<pair<double, double>> moments(patterns.size(), {0.0, 0.0});
+        bool by_subsequence = engine == MiningEngine::PatternGrowth || engine == MiningEngine::VerticalBitmap;
+        bool by_sequence = by_subsequence || engine == MiningEngine::SuffixAutomaton;
+        
+        unordered_map<string, size_t> lookup;
+        for (size_t i = 0; i < patterns.size() && !by_subsequence; ++i) {
+            const vector<TokenId>& tokens = get<0>(patterns[i]);
+            lookup.emplace(string(reinterpret_cast<const char*>(tokens.data()), tokens.size() * sizeof(TokenId)), i);
+        }
+        
+        unordered_map<size_t, int> counts;
+        string key;
+        auto count = [&](const TokenId* tokens, size_t length) {
+            key.assign(reinterpret_cast<const char*>(tokens), length * sizeof(TokenId));
+            auto it = lookup.find(key);
+            if (it != lookup.end()) counts[it->second]++;
+        };
+        for (const SequenceData& data : sample) {
+            counts.clear();
+            if (by_subsequence) {
+                for (size_t i = 0; i < patterns.size(); ++i) {
+                    const vector<TokenId>& tokens = get<0>(patterns[i]);
+                    size_t matched = 0;
+                    for (size_t j = 0; j < data.sequence.size() && matched < tokens.size(); ++j) {
+                        if (data.sequence[j] == tokens[matched]) matched++;
+                    }
+                    if (matched == tokens.size()) counts[i] = 1;
+                }
+            } else if (engine == MiningEngine::PackedNgram || engine == MiningEngine::SuffixAutomaton) {
+                int sequence_len = static_cast<int>(data.sequence.size());
+                for (int length = max(min_length, 1); length <= min(max_length, sequence_len); ++length) {
+                    for (int start = 0; start <= sequence_len - length; ++start) {
+                        count(data.sequence.data() + start, static_cast<size_t>(length));
+                    }
+                }
+            } else {
+                for_each_subsequence(data.sequence, min_length, max_length, 
+                                     [&](const TokenId* tokens, size_t length, int, bool) { count(tokens, length); }, 
+                                     gap_constraints);
+            }
+            for (const auto& pattern_count : counts) {
+                double c = by_sequence ? 1.0 : static_cast<double>(pattern_count.second);
+                moments[pattern_count.first].first += c * data.weight;
+                moments[pattern_count.first].second += c * c * data.weight;
+            }
+        }
+        return moments;
+    }
+    
+    // Shared by mine_frequent_patterns_sampled (unbounded limit) and find_top_k_patterns_sampled
+    SampledMiningResult mine_sampled(size_t limit, int min_support, bool noncontiguous_only, 
+                                     const SamplingOptions& options) {
+        auto start_time = high_resolution_clock::now();
+        SampledMiningResult result;
+        result.population = sequence_index.size();
+        min_support = max(min_support, 1);
+        if (result.population == 0) return result;
+        
+        double z = normal_quantile(0.5 + min(max(options.confidence, 0.5), 0.999999) / 2);
+        double population = static_cast<double>(result.population);
+        // Per-draw variance of a pattern's count at rate p. The engines that count
+        // sequences are Bernoulli; for Trie and PackedNgram, which count occurrences,
+        // it is measured from the sample, and taken as Poisson only for the threshold.
+        bool counts_occurrences = engine == MiningEngine::Trie || engine == MiningEngine::PackedNgram;
+        auto draw_variance = [counts_occurrences](double p) {
+            return counts_occurrences ? p : min(p, 1.0) * (1 - min(p, 1.0));
+        };
+        
+        // Draws pick live copies uniformly, so a deduplicated slot is picked by its weight
+        vector<uint64_t> cumulative;
+        if (deduplicate) {
+            cumulative.reserve(sequence_database.size());
+            uint64_t total = 0;
+            for (const SequenceData& data : sequence_database) cumulative.push_back(total += data.weight);
+        }
+        mt19937_64 rng(options.seed);
+        uniform_int_distribution<uint64_t> pick(0, result.population - 1);
+        auto draw_into = [&](mt19937_64& generator, map<size_t, int>& drawn) {
+            uint64_t draw = pick(generator);
+            size_t slot = deduplicate 
+                ? static_cast<size_t>(upper_bound(cumulative.begin(), cumulative.end(), draw) - cumulative.begin()) 
+                : static_cast<size_t>(draw);
+            drawn[slot]++;
+        };
+        auto make_sample = [&](const map<size_t, int>& drawn) {
+            vector<SequenceData> sample;
+            sample.reserve(drawn.size());
+            for (const auto& slot_count : drawn) {
+                sample.emplace_back(static_cast<int>(sample.size()), sequence_database[slot_count.first].sequence, 
+                                    slot_count.second);
+            }
+            return sample;
+        };
+        map<size_t, int> drawn;  // slot -> times drawn, which becomes the sample weight
+        size_t draws = 0;
+        
+        // Top-k picks the patterns that rank highest in the sample, whose counts
+        // are then biased upwards (the winner's curse), so they are estimated on
+        // a second, independent draw of the same size instead
+        bool recount = limit != numeric_limits<size_t>::max();
+        mt19937_64 recount_rng(options.seed ^ 0x9e3779b97f4a7c15ULL);
+        map<size_t, int> recount_drawn;
+        
+        QueryProfile profile;
+        size_t target = max<size_t>(1, options.initial_sample);
+        while (true) {
+            auto round_start = high_resolution_clock::now();
+            result.rounds++;
+            
+            if (target >= result.population) {
+                // A sample this large costs about as much as the database; mine it in full
+                vector<PatternInfo> exact = limit == numeric_limits<size_t>::max() 
+                    ? mine_frequent_patterns(min_support, noncontiguous_only) 
+                    : find_top_k_patterns(static_cast<int>(limit), min_support, noncontiguous_only);
+                result.patterns.clear();
+                for (const PatternInfo& p : exact) {
+                    result.patterns.emplace_back(p.pattern, p.pattern_string, p.frequency, p.frequency, 
+                                                 p.frequency, p.support, p.is_noncontiguous);
+                }
+                result.sample_size = result.population;
+                result.sample_min_support = min_support;
+                result.relative_error = 0.0;
+                result.exact = result.target_met = true;
+                break;
+            }
+            
+            for (size_t i = draws; i < target; ++i) {
+                draw_into(rng, drawn);
+                if (recount) draw_into(recount_rng, recount_drawn);
+            }
+            draws = target;
+            vector<SequenceData> sample = make_sample(drawn);
+            
+            // Lower the threshold by the interval margin at min_support's rate, so a
+            // pattern at min_support is only missed when its sample count is unusually low
+            double n = static_cast<double>(draws);
+            double threshold_rate = min_support / population;
+            double lowered = threshold_rate * n - z * sqrt(draw_variance(threshold_rate) * n);
+            result.sample_min_support = max(1, static_cast<int>(floor(lowered)));
+            vector<PatternCount> sample_patterns = mine_sample(sample, limit, result.sample_min_support, 
+                                                               noncontiguous_only, profile);
+            
+            vector<pair<double, double>> moments;
+            if (recount) {
+                moments = sample_count_moments(make_sample(recount_drawn), sample_patterns);
+            } else if (counts_occurrences) {
+                moments = sample_count_moments(sample, sample_patterns);
+            }
+            
+            // Keep patterns that cannot be ruled out as below min_support
+            result.patterns.clear();
+            result.relative_error = 0.0;
+            for (size_t i = 0; i < sample_patterns.size(); ++i) {
+                const PatternCount& p = sample_patterns[i];
+                double rate = (recount ? moments[i].first : get<1>(p)) / n;
+                double variance = moments.empty() ? draw_variance(rate) 
+                                                  : max(moments[i].second / n - rate * rate, 0.0);
+                double half_width = z * sqrt(variance / n);
+                double upper = counts_occurrences ? rate + half_width : min(rate + half_width, 1.0);
+                if (upper * population < min_support) continue;
+                
+                vector<string> pattern = symbols.decode(get<0>(p));
+                string pattern_string = join_pattern(pattern);
+                result.patterns.emplace_back(move(pattern), move(pattern_string), rate * population, 
+                                             max(rate - half_width, 0.0) * population, upper * population, 
+                                             rate, get<2>(p));
+                result.relative_error = max(result.relative_error, half_width / rate);
+            }
+            if (recount) {
+                stable_sort(result.patterns.begin(), result.patterns.end(), 
+                            [](const SampledPatternEstimate& a, const SampledPatternEstimate& b) {
+                                return a.frequency > b.frequency;
+                            });
+            }
+            result.sample_size = draws;
+            
+            // An empty result proves nothing about unseen patterns, so it never meets the target
+            result.target_met = options.target_error > 0 && !result.patterns.empty() && 
+                                result.relative_error <= options.target_error;
+            double round_ms = elapsed_ms(round_start);
+            if (result.target_met || options.time_budget_ms <= 0 || 
+                elapsed_ms(start_time) + 2 * round_ms > options.time_budget_ms) {
+                break;
+            }
+            target = draws * 2;
+        }
+        
+        result.elapsed_ms = elapsed_ms(start_time);
+        if (!result.exact) {
+            auto end_time = high_resolution_clock::now();
+            record_query(profile, start_time, start_time, end_time, result.patterns.size());
+        }
+        return result;
+    }
+    
+    // Rebuilds the automaton / bitmaps / n-gram counts if sequences changed since the last query
+    void refresh_engine_index() {
+        if (!engine_index_stale) return;
+        if (engine == MiningEngine::SuffixAutomaton) {
+            automaton.build(sequence_database);
+        } else if (engine == MiningEngine::VerticalBitmap) {
+            bitmap_index.build(sequence_database, symbols.size());
+        } else if (engine == MiningEngine::PackedNgram) {
+            ngram_index.build(sequence_database, symbols.size(), min_length, max_length, num_threads);
+        }
+        engine_index_stale = false;
+    }
+    
+    // Tokens are decoded back to strings only for the rendered result
+    vector<PatternInfo> to_pattern_infos(const vector<PatternCount>& pattern_counts) const {
+        vector<PatternInfo> enhanced_patterns;
+        enhanced_patterns.reserve(pattern_counts.size());
+        for (const auto& pattern_tuple : pattern_counts) {
+            vector<string> pattern = symbols.decode(get<0>(pattern_tuple));
+            int frequency = get<1>(pattern_tuple);
+            bool is_noncontiguous = get<2>(pattern_tuple);
+            
+            double support = sequence_index.empty() ? 0.0 : 
+                           static_cast<double>(frequency) / sequence_index.size();
+            
+            string pattern_string = join_pattern(pattern);
+            string pattern_type = is_noncontiguous ? "Non-contiguous" : "Contiguous";
+            
+            enhanced_patterns.emplace_back(pattern, frequency, static_cast<int>(pattern.size()), 
+                                         support, pattern_string, is_noncontiguous, pattern_type);
+        }
+        
+        return enhanced_patterns;
+    }
+    
+    // Splits a query's wall time into phases; PatternInfo construction runs until now
+    void record_query(const QueryProfile& profile, high_resolution_clock::time_point start_time, 
+                      high_resolution_clock::time_point refreshed_time, 
+                      high_resolution_clock::time_point extracted_time, size_t kept) {
+        auto end_time = high_resolution_clock::now();
+        statistics.engine = engine_name(engine);
+        statistics.mining_time = elapsed_ms(start_time, end_time);
+        statistics.index_refresh_time = elapsed_ms(start_time, refreshed_time);
+        statistics.sort_time = profile.sort_time;
+        statistics.extraction_time = max(0.0, elapsed_ms(refreshed_time, extracted_time) - profile.sort_time);
+        statistics.pattern_info_time = elapsed_ms(extracted_time, end_time);
+        statistics.candidates_generated = profile.candidates;
+        statistics.candidates_kept = static_cast<long long>(kept);
+        statistics.total_patterns_found = static_cast<int>(kept);
+    }
+    
+    void record_cache_hit(high_resolution_clock::time_point start_time, size_t kept) {
+        statistics.engine = engine_name(engine);
+        statistics.mining_time = elapsed_ms(start_time);
+        statistics.index_refresh_time = statistics.extraction_time = statistics.sort_time = 0.0;
+        statistics.pattern_info_time = statistics.mining_time;
+        statistics.candidates_generated = 0;
+        statistics.candidates_kept = static_cast<long long>(kept);
+        statistics.total_patterns_found = static_cast<int>(kept);
+    }
+    
+    string join_pattern(const vector<string>& pattern, const string& delimiter = " -> ") const {
+        string joined;
+        for (size_t i = 0; i < pattern.size(); ++i) {
+            if (i > 0) joined += delimiter;
+            joined += pattern[i];
+        }
+        return joined;
+    }
+    
+public:
+    AdvancedSubsequenceMiner(int min_len = 2, int max_len = 10, int threads = 1) 
+        : min_length(min_len), max_length(max_len), next_sequence_id(0), num_threads(threads), 
+          track_positions(true), deduplicate(false), engine(MiningEngine::Trie), engine_index_stale(true), 
+          dataset_version(0), cache_results(true) {}
+    
+    // Only the Trie engine keeps an incremental index; switching back to it rebuilds one
+    void set_engine(MiningEngine new_engine) {
+        if (new_engine == engine) return;
+        engine = new_engine;
+        if (engine == MiningEngine::Trie) {
+            rebuild_index();
+        } else {
+            trie = SubsequenceTrie(track_positions);
+        }
+        if (engine != MiningEngine::SuffixAutomaton) {
+            automaton = SuffixAutomaton();
+        }
+        if (engine != MiningEngine::VerticalBitmap) {
+            bitmap_index = VerticalBitmapIndex();
+        }
+        if (engine != MiningEngine::PackedNgram) {
+            ngram_index = PackedNgramIndex();
+        }
+        engine_index_stale = true;
+    }
+    MiningEngine get_engine() const { return engine; }
+    
+    // Worker threads used by add_sequences and rebuild_index
+    void set_num_threads(int threads) { num_threads = max(threads, 1); }
+    int get_num_threads() const { return num_threads; }
+    
+    // Position tracking is on by default; changing it rebuilds the trie
+    void set_position_tracking(bool enabled) {
+        if (enabled == track_positions) return;
+        track_positions = enabled;
+        if (engine == MiningEngine::Trie) rebuild_index();
+    }
+    bool get_position_tracking() const { return track_positions; }
+    
+    // Deduplication (off by default) stores each distinct sequence once, weighted
+    // by its copies, so indexing and mining scale with distinct sequences while
+    // every count and support stays that of the raw data. Changing it re-indexes.
+    void set_deduplication(bool enabled) {
+        if (enabled == deduplicate) return;
+        deduplicate = enabled;
+        regroup_sequences();
+        mark_dataset_changed();
+        if (engine == MiningEngine::Trie) rebuild_index();
+    }
+    bool get_deduplication() const { return deduplicate; }
+    
+    // Limits the non-contiguous occurrences the Trie engine indexes to those
+    // within max_gap skipped events of each other (and at least min_gap) and
+    // spanning at most max_window events. With a max_gap or max_window only
+    // allowed occurrences are ever enumerated, so long sequences are mined in
+    // full instead of being limited to windows; a min_gap alone keeps those
+    // limits. The other engines do not apply them. Changing them re-indexes.
+    void set_gap_constraints(const GapConstraints& constraints) {
+        if (constraints.normalized() == gap_constraints) return;
+        
+        gap_constraints = constraints.normalized();
+        mark_dataset_changed();
+        if (engine == MiningEngine::Trie) rebuild_index();
+    }
+    const GapConstraints& get_gap_constraints() const { return gap_constraints; }
+    
+    // Lets the Trie engine index up to node_capacity nodes without reallocating
+    void reserve_index(size_t node_capacity) { trie.reserve(node_capacity); }
+    
+    // Result caching is on by default; disabling it also drops cached results
+    void set_result_caching(bool enabled) {
+        cache_results = enabled;
+        if (!enabled) pattern_cache.clear();
+    }
+    bool get_result_caching() const { return cache_results; }
+    
+    // End nodes of the patterns, resolved in one pass over the trie; nullptr when
+    // absent or when the engine is not Trie
+    template <typename Token>
+    vector<const TrieNode*> find_pattern_nodes(const vector<vector<Token>>& patterns) const {
+        if (engine != MiningEngine::Trie) return vector<const TrieNode*>(patterns.size(), nullptr);
+        
+        vector<vector<TokenId>> encoded(patterns.size());
+        for (size_t i = 0; i < patterns.size(); ++i) {
+            encoded[i].reserve(patterns[i].size());
+            for (const Token& token : patterns[i]) {
+                TokenId id;
+                // Unknown tokens become an id no edge carries
+                encoded[i].push_back(symbols.find(token, id) ? id : numeric_limits<TokenId>::max());
+            }
+        }
+        return trie.search_patterns(encoded);
+    }
+    
+    // Frequency and support of each pattern, resolved in one pass over the trie;
+    // absent patterns (or any engine other than Trie) get frequency 0
+    vector<PatternInfo> search_patterns(const vector<vector<string>>& patterns) const {
+        vector<const TrieNode*> found = find_pattern_nodes(patterns);
+        
+        vector<PatternInfo> results;
+        results.reserve(patterns.size());
+        for (size_t i = 0; i < patterns.size(); ++i) {
+            int frequency = found[i] ? found[i]->frequency : 0;
+            bool is_noncontiguous = found[i] && found[i]->is_noncontiguous();
+            double support = sequence_index.empty() ? 0.0 : 
+                             static_cast<double>(frequency) / sequence_index.size();
+            results.emplace_back(patterns[i], frequency, static_cast<int>(patterns[i].size()), support, 
+                                 join_pattern(patterns[i]), is_noncontiguous, 
+                                 is_noncontiguous ? "Non-contiguous" : "Contiguous");
+        }
+        return results;
+    }
+    
+    PatternInfo search_pattern(const vector<string>& pattern) const {
+        return search_patterns({pattern}).front();
+    }
+    
+    // (frequency, is_noncontiguous) of each pattern, like search_patterns but with
+    // tokens passed as views and no PatternInfo built; for bulk counting
+    vector<pair<int, bool>> count_patterns(const vector<vector<string_view>>& patterns) const {
+        vector<const TrieNode*> found = find_pattern_nodes(patterns);
+        vector<pair<int, bool>> counts;
+        counts.reserve(found.size());
+        for (const TrieNode* node : found) {
+            counts.emplace_back(node ? node->frequency : 0, node && node->is_noncontiguous());
+        }
+        return counts;
+    }
+    
+    // Where a pattern occurs, as (sequence id, start position) pairs. Empty when the
+    // pattern is not indexed, positions are not tracked, or the engine is not Trie.
+    // Non-contiguous occurrences are reported by their first token's position.
+    vector<Position> find_pattern_positions(const vector<string>& pattern) const {
+        vector<TokenId> encoded;
+        encoded.reserve(pattern.size());
+        for (const string& token : pattern) {
+            TokenId id;
+            if (!symbols.find(token, id)) return {};
+            encoded.push_back(id);
+        }
+        if (engine != MiningEngine::Trie) return {};
+        
+        vector<Position> positions = trie.get_positions(encoded);
+        if (!deduplicate) return positions;
+        
+        // Positions are kept once per distinct sequence; repeat them for each copy
+        vector<Position> expanded;
+        expanded.reserve(positions.size());
+        for (const Position& position : positions) {
+            auto it = group_members.find(position.sequence_id);
+            if (it == group_members.end()) continue;
+            for (int member : it->second) expanded.emplace_back(member, position.position);
+        }
+        stable_sort(expanded.begin(), expanded.end(), 
+                    [](const Position& a, const Position& b) { return a.sequence_id < b.sequence_id; });
+        return expanded;
+    }
+    
+    // Indexes the sequence immediately; returns -1 if sequence_id is already in use
+    int add_sequence(const vector<string>& sequence, int sequence_id = -1) {
+        if (sequence_id == -1) {
+            sequence_id = next_sequence_id;
+        }
+        // A removed copy's id may still name its distinct sequence's positions
+        if (sequence_index.count(sequence_id) || group_members.count(sequence_id)) {
+            return -1;
+        }
+        next_sequence_id = max(next_sequence_id, sequence_id + 1);
+        
+        bool distinct = place_sequence(sequence_id, symbols.encode(sequence));
+        arrival_order.push_back(sequence_id);
+        mark_dataset_changed();
+        if (engine == MiningEngine::Trie) {
+            generate_subsequences(trie, sequence_database[sequence_index[sequence_id]].sequence, 
+                                  distinct ? sequence_id : -1, statistics.indexing);
+        }
+        statistics.total_sequences++;
+        
+        return sequence_id;
+    }
+    
+    // Bulk variant of add_sequence that indexes the batch on num_threads workers.
+    // Returns the ids assigned to the batch, in order.
+    vector<int> add_sequences(const vector<vector<string>>& sequences) {
+        vector<vector<TokenId>> encoded;
+        encoded.reserve(sequences.size());
+        for (const auto& sequence : sequences) {
+            encoded.push_back(symbols.encode(sequence));
+        }
+        return add_encoded_sequences(move(encoded));
+    }
+    
+    // Same as add_sequences for sequences already interned in this miner's symbols.
+    // With deduplication the batch is grouped by content first, so each distinct
+    // sequence is enumerated once with its copies as weight.
+    vector<int> add_encoded_sequences(vector<vector<TokenId>> sequences) {
+        vector<int> ids;
+        ids.reserve(sequences.size());
+        size_t first = sequence_database.size();
+        if (!deduplicate) sequence_database.reserve(first + sequences.size());
+        map<size_t, int> added_weight;  // earlier slots that gained copies
+        
+        for (auto& sequence : sequences) {
+            int sequence_id = next_sequence_id++;
+            if (!place_sequence(sequence_id, move(sequence)) && sequence_index[sequence_id] < first) {
+                added_weight[sequence_index[sequence_id]]++;
+            }
+            arrival_order.push_back(sequence_id);
+            ids.push_back(sequence_id);
+        }
+        mark_dataset_changed();
+        
+        if (engine == MiningEngine::Trie) {
+            index_sequences(trie, sequence_database, first, sequence_database.size(), statistics.indexing);
+            for (const auto& slot_weight : added_weight) {
+                generate_subsequences(trie, sequence_database[slot_weight.first].sequence, -1, 
+                                      statistics.indexing, slot_weight.second);
+            }
+        }
+        statistics.total_sequences += static_cast<int>(ids.size());
+        return ids;
+    }
+    
+    // Bulk-loads a newline-delimited event log (one sequence per line, tokens
+    // separated by spaces or tabs). The file is memory-mapped and split into
+    // num_threads newline-aligned chunks that are tokenized in parallel with
+    // string_view slices; only each chunk's distinct tokens are interned.
+    // With shard_count > 1 only the shard-th of shard_count newline-aligned
+    // byte ranges is read, so shards of one file cover each line exactly once.
+    IngestStatistics ingest_file(const string& path, size_t shard = 0, size_t shard_count = 1) {
+        IngestStatistics result;
+        auto start_time = high_resolution_clock::now();
+        
+        MappedFile file(path);
+        if (!file.is_open()) {
+            result.error = file.get_error();
+            return result;
+        }
+        string_view text = file.contents();
+        if (shard_count > 1) {
+            // A range starts at the first line beginning at or after its nominal offset
+            auto line_start = [&text](size_t offset) {
+                if (offset == 0) return size_t(0);
+                size_t newline = text.find('\n', offset - 1);
+                return newline == string_view::npos ? text.size() : newline + 1;
+            };
+            size_t begin = line_start(text.size() * shard / shard_count);
+            size_t end = line_start(text.size() * (shard + 1) / shard_count);
+            text = text.substr(begin, end - begin);
+        }
+        result.bytes = text.size();
+        
+        size_t chunk_count = max<size_t>(1, min<size_t>(static_cast<size_t>(max(num_threads, 1)), 
+                                                        text.size() / (1 << 20) + 1));
+        vector<string_view> slices;
+        size_t begin = 0;
+        for (size_t c = 1; c <= chunk_count && begin < text.size(); ++c) {
+            size_t end = c == chunk_count ? text.size() : text.size() * c / chunk_count;
+            if (end < begin) end = begin;
+            size_t newline = text.find('\n', end);
+            end = newline == string_view::npos ? text.size() : newline + 1;
+            slices.push_back(text.substr(begin, end - begin));
+            begin = end;
+        }
+        
+        vector<ParsedChunk> chunks(slices.size());
+        if (chunks.size() == 1) {
+            chunks[0].parse(slices[0]);
+        } else {
+            vector<thread> parsers;
+            for (size_t c = 0; c < chunks.size(); ++c) {
+                parsers.emplace_back([&chunks, &slices, c]() { chunks[c].parse(slices[c]); });
+            }
+            for (auto& parser : parsers) parser.join();
+        }
+        
+        // Intern chunk by chunk in file order so IDs match a serial read
+        vector<vector<TokenId>> encoded;
+        for (const ParsedChunk& chunk : chunks) {
+            vector<TokenId> remap;
+            remap.reserve(chunk.local_symbols.size());
+            for (string_view token : chunk.local_symbols) {
+                remap.push_back(symbols.intern(token));
+            }
+            
+            size_t sequence_start = 0;
+            for (size_t sequence_end : chunk.sequence_ends) {
+                vector<TokenId> sequence;
+                sequence.reserve(sequence_end - sequence_start);
+                for (size_t t = sequence_start; t < sequence_end; ++t) {
+                    sequence.push_back(remap[chunk.tokens[t]]);
+                }
+                encoded.push_back(move(sequence));
+                sequence_start = sequence_end;
+            }
+            result.tokens += chunk.tokens.size();
+        }
+        result.sequences = encoded.size();
+        
+        auto parsed_time = high_resolution_clock::now();
+        add_encoded_sequences(move(encoded));
+        auto end_time = high_resolution_clock::now();
+        
+        result.parse_time = duration_cast<microseconds>(parsed_time - start_time).count() / 1000.0;
+        result.index_time = duration_cast<microseconds>(end_time - parsed_time).count() / 1000.0;
+        result.success = true;
+        return result;
+    }
+    
+    // Writes the trie, symbol table and sequences (in arrival order) as a
+    // snapshot that IndexSnapshot can query in place. Needs the Trie engine.
+    bool save_snapshot(const string& path, string* error = nullptr) const {
+        auto fail = [&](const string& message) {
+            if (error) *error = message;
+            return false;
+        };
+        if (engine != MiningEngine::Trie) return fail("snapshots need the trie engine");
+        if (deduplicate && track_positions) {
+            return fail("snapshots of a deduplicated index need position tracking off");
+        }
+        
+        ofstream out(path, ios::binary | ios::trunc);
+        if (!out) return fail("cannot open " + path + ": " + strerror(errno));
+        
+        SnapshotHeader header = {};
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        header.format_version = SNAPSHOT_VERSION;
+        header.header_bytes = sizeof(SnapshotHeader);
+        header.min_length = min_length;
+        header.max_length = max_length;
+        header.track_positions = track_positions;
+        header.next_sequence_id = next_sequence_id;
+        header.min_gap = gap_constraints.min_gap;
+        header.max_gap = gap_constraints.max_gap;
+        header.max_window = gap_constraints.max_window;
+        
+        uint64_t offset = 0;
+        auto write_section = [&](const void* data, uint64_t bytes) {
+            static const char padding[8] = {};
+            out.write(padding, static_cast<streamsize>((8 - offset % 8) % 8));
+            offset += (8 - offset % 8) % 8;
+            uint64_t start = offset;
+            out.write(static_cast<const char*>(data), static_cast<streamsize>(bytes));
+            offset += bytes;
+            return start;
+        };
+        write_section(&header, sizeof(header));  // rewritten once the offsets are known
+        
+        vector<SnapshotNode> flat_nodes;
+        vector<TrieEdge> flat_edges;
+        vector<uint8_t> posting_bytes;
+        trie.export_flat(flat_nodes, flat_edges, posting_bytes);
+        header.node_count = flat_nodes.size();
+        header.edge_count = flat_edges.size();
+        header.posting_bytes = posting_bytes.size();
+        header.nodes_offset = write_section(flat_nodes.data(), flat_nodes.size() * sizeof(SnapshotNode));
+        header.edges_offset = write_section(flat_edges.data(), flat_edges.size() * sizeof(TrieEdge));
+        header.postings_offset = write_section(posting_bytes.data(), posting_bytes.size());
+        
+        vector<uint64_t> symbol_offsets = {0};
+        string symbol_text;
+        vector<TokenId> symbol_order(symbols.size());
+        for (TokenId id = 0; id < symbols.size(); ++id) {
+            symbol_text += symbols.decode(id);
+            symbol_offsets.push_back(symbol_text.size());
+            symbol_order[id] = id;
+        }
+        sort(symbol_order.begin(), symbol_order.end(), 
+             [this](TokenId a, TokenId b) { return symbols.decode(a) < symbols.decode(b); });
+        header.symbol_count = symbols.size();
+        header.symbol_bytes = symbol_text.size();
+        header.symbol_offsets_offset = write_section(symbol_offsets.data(), symbol_offsets.size() * sizeof(uint64_t));
+        header.symbol_text_offset = write_section(symbol_text.data(), symbol_text.size());
+        header.symbol_order_offset = write_section(symbol_order.data(), symbol_order.size() * sizeof(TokenId));
+        
+        vector<int32_t> ids;
+        vector<uint64_t> sequence_offsets = {0};
+        vector<TokenId> tokens;
+        unordered_set<int> written;
+        for (int sequence_id : arrival_order) {
+            auto it = sequence_index.find(sequence_id);
+            if (it == sequence_index.end() || !written.insert(sequence_id).second) continue;
+            const vector<TokenId>& sequence = sequence_database[it->second].sequence;
+            ids.push_back(sequence_id);
+            tokens.insert(tokens.end(), sequence.begin(), sequence.end());
+            sequence_offsets.push_back(tokens.size());
+        }
+        header.sequence_count = ids.size();
+        header.token_count = tokens.size();
+        header.sequence_ids_offset = write_section(ids.data(), ids.size() * sizeof(int32_t));
+        header.sequence_offsets_offset = write_section(sequence_offsets.data(), 
+                                                       sequence_offsets.size() * sizeof(uint64_t));
+        header.sequence_tokens_offset = write_section(tokens.data(), tokens.size() * sizeof(TokenId));
+        header.file_bytes = offset;
+        
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.close();
+        if (!out) return fail("cannot write " + path);
+        return true;
+    }
+    
+    // Replaces the miner's contents with a snapshot. Pattern lengths and
+    // position tracking come from the snapshot; with the Trie engine the trie
+    // is copied from the snapshot's nodes instead of regenerating subsequences.
+    bool load_snapshot(const string& path, string* error = nullptr) {
+        IndexSnapshot snapshot(path);
+        if (!snapshot.is_open()) {
+            if (error) *error = snapshot.get_error();
+            return false;
+        }
+        const SnapshotHeader& header = snapshot.get_header();
+        
+        min_length = header.min_length;
+        max_length = header.max_length;
+        track_positions = header.track_positions != 0;
+        next_sequence_id = header.next_sequence_id;
+        gap_constraints.min_gap = header.min_gap;
+        gap_constraints.max_gap = header.max_gap;
+        gap_constraints.max_window = header.max_window;
+        
+        symbols = SymbolTable();
+        for (TokenId id = 0; id < header.symbol_count; ++id) {
+            symbols.intern(snapshot.symbol(id));
+        }
+        
+        sequence_database.clear();
+        sequence_index.clear();
+        content_index.clear();
+        group_members.clear();
+        arrival_order.clear();
+        if (!deduplicate) sequence_database.reserve(snapshot.sequence_count());
+        for (size_t i = 0; i < snapshot.sequence_count(); ++i) {
+            const TokenId* begin = snapshot.sequence_begin(i);
+            int sequence_id = snapshot.sequence_id(i);
+            if (sequence_index.count(sequence_id)) continue;  // repeated by older snapshots
+            place_sequence(sequence_id, vector<TokenId>(begin, begin + snapshot.sequence_length(i)));
+            arrival_order.push_back(sequence_id);
+        }
+        
+        statistics = MiningStatistics();
+        statistics.total_sequences = static_cast<int>(sequence_index.size());
+        mark_dataset_changed();
+        
+        trie = SubsequenceTrie(track_positions);
+        if (engine == MiningEngine::Trie) {
+            // The snapshot's positions name every copy; a deduplicated trie names one per sequence
+            if (deduplicate && track_positions) {
+                rebuild_index();
+            } else {
+                trie.import_flat(snapshot.node_data(), header.node_count, snapshot.edge_data(), 
+                                 snapshot.posting_data());
+            }
+        }
+        return true;
+    }
+    
+    // Discards the index and rebuilds it from sequence_database
+    void rebuild_index() {
+        trie = SubsequenceTrie(track_positions);
+        statistics.indexing = IndexProfile();
+        if (engine == MiningEngine::Trie) {
+            index_sequences(trie, sequence_database, 0, sequence_database.size(), statistics.indexing);
+        }
+    }
+    
+    // Withdraws the given sequences from the index; unknown ids are ignored.
+    // Their arrival_order entries are dropped too, so a later add_sequence
+    // that reuses an id is not expired in place of older sequences.
+    int remove_sequences(const vector<int>& sequence_ids) {
+        unordered_set<int> removed;
+        int count = withdraw_sequences(sequence_ids, removed);
+        if (count > 0) {
+            arrival_order.erase(remove_if(arrival_order.begin(), arrival_order.end(), 
+                                          [&](int sequence_id) { return removed.count(sequence_id) > 0; }), 
+                                arrival_order.end());
+        }
+        return count;
+    }
+    
+    bool remove_sequence(int sequence_id) {
+        return remove_sequences({sequence_id}) == 1;
+    }
+    
+    // Removes the oldest sequences until at most max_sequences remain
+    int expire_sequences(size_t max_sequences) {
+        vector<int> expired;
+        size_t remaining = sequence_index.size();
+        
+        // Removed ids leave arrival_order, so every entry popped here is live
+        while (remaining > max_sequences && !arrival_order.empty()) {
+            expired.push_back(arrival_order.front());
+            arrival_order.pop_front();
+            remaining--;
+        }
+        
+        unordered_set<int> removed;
+        return withdraw_sequences(expired, removed);
+    }
+    
+private:
+    // Takes the given sequences out of the index and sequence_database, leaving
+    // arrival_order to the caller; the ids withdrawn are added to removed.
+    // Copies of one distinct sequence are withdrawn together, as one weight.
+    int withdraw_sequences(const vector<int>& sequence_ids, unordered_set<int>& removed) {
+        map<size_t, int> removed_weight;  // slot -> copies withdrawn
+        
+        for (int sequence_id : sequence_ids) {
+            auto it = sequence_index.find(sequence_id);
+            if (it == sequence_index.end()) continue;
+            removed_weight[it->second]++;
+            sequence_index.erase(it);
+            removed.insert(sequence_id);
+        }
+        if (removed.empty()) return 0;
+        
+        unordered_set<int> emptied;  // ids whose slot lost its last copy
+        for (const auto& slot_weight : removed_weight) {
+            SequenceData& data = sequence_database[slot_weight.first];
+            if (engine == MiningEngine::Trie) {
+                generate_subsequences(trie, data.sequence, data.id, statistics.indexing, 
+                                      slot_weight.second, true);
+            }
+            data.weight -= slot_weight.second;
+            if (data.weight == 0) {
+                emptied.insert(data.id);
+            } else if (deduplicate) {
+                vector<int>& members = group_members[data.id];
+                members.erase(remove_if(members.begin(), members.end(), 
+                                        [&](int member) { return removed.count(member) > 0; }), 
+                              members.end());
+            }
+        }
+        
+        // Highest slot first, so the slot moved into a gap is never one still to drop
+        for (auto it = removed_weight.rbegin(); it != removed_weight.rend(); ++it) {
+            if (sequence_database[it->first].weight == 0) drop_slot(it->first);
+        }
+        
+        mark_dataset_changed();
+        trie.remove_positions(emptied);
+        statistics.total_sequences -= static_cast<int>(removed.size());
+        return static_cast<int>(removed.size());
+    }
+    
+public:
+    // Read-only pass over the index built by add_sequence. With the PatternGrowth
+    // engine every result is a subsequence pattern, so noncontiguous_only has no effect;
+    // the SuffixAutomaton engine is rebuilt after data changes and only finds
+    // contiguous patterns, so it returns nothing for noncontiguous_only.
+    // VerticalBitmap is also rebuilt after data changes and reports both kinds.
+    // PackedNgram is rebuilt the same way and, like SuffixAutomaton, finds only
+    // contiguous patterns, but counts occurrences rather than sequences.
+    // closure keeps only closed or maximal patterns: Trie and PatternGrowth decide it
+    // during the search, the other engines filter their full result (closure among
+    // contiguous patterns for SuffixAutomaton). It is judged before noncontiguous_only.
+    vector<PatternInfo> mine_frequent_patterns(int min_support = 2, bool noncontiguous_only = false, 
+                                               PatternClosure closure = PatternClosure::All) {
+        auto start_time = high_resolution_clock::now();
+        min_support = max(min_support, 1);
+        
+        vector<PatternInfo> cached;
+        if (lookup_cached(min_support, noncontiguous_only, closure, numeric_limits<size_t>::max(), cached)) {
+            record_cache_hit(start_time, cached.size());
+            return cached;
+        }
+        
+        refresh_engine_index();
+        auto refreshed_time = high_resolution_clock::now();
+        
+        QueryProfile profile;
+        vector<PatternCount> frequent_patterns = extract_frequent_patterns(min_support, noncontiguous_only, 
+                                                                           closure, profile);
+        auto extracted_time = high_resolution_clock::now();
+        
+        vector<PatternInfo> enhanced_patterns = to_pattern_infos(frequent_patterns);
+        
+        record_query(profile, start_time, refreshed_time, extracted_time, enhanced_patterns.size());
+        store_cached(min_support, noncontiguous_only, closure, enhanced_patterns);
+        return enhanced_patterns;
+    }
+    
+    // Bounded top-k: engines feed a size-k heap whose worst frequency raises the
+    // support threshold as it fills, and PatternInfo is built for the final k only
+    vector<PatternInfo> find_top_k_patterns(int k = 10, int min_support = 2, 
+                                           bool noncontiguous_only = false, 
+                                           PatternClosure closure = PatternClosure::All) {
+        auto start_time = high_resolution_clock::now();
+        size_t capacity = static_cast<size_t>(max(k, 0));
+        min_support = max(min_support, 1);
+        
+        vector<PatternInfo> cached;
+        if (lookup_cached(min_support, noncontiguous_only, closure, capacity, cached)) {
+            record_cache_hit(start_time, cached.size());
+            return cached;
+        }
+        
+        refresh_engine_index();
+        auto refreshed_time = high_resolution_clock::now();
+        
+        QueryProfile profile;
+        vector<PatternCount> top_patterns;
+        if (engine == MiningEngine::PatternGrowth) {
+            PrefixSpanMiner prefix_span(sequence_database, symbols.size(), min_length, max_length);
+            top_patterns = prefix_span.mine_top_k(capacity, min_support, closure, &profile);
+        } else if (closure != PatternClosure::All && engine != MiningEngine::Trie) {
+            // The filtering engines need every frequent pattern before they can rank
+            if (engine == MiningEngine::VerticalBitmap) {
+                top_patterns = filtered_bitmap_patterns(min_support, noncontiguous_only, closure, &profile);
+            } else if (noncontiguous_only) {
+                // Neither contiguous-only engine has non-contiguous patterns
+            } else if (engine == MiningEngine::PackedNgram) {
+                top_patterns = ngram_index.get_frequent_patterns(min_support, &profile);
+                filter_by_closure(top_patterns, closure, true);
+            } else {
+                top_patterns = automaton.get_frequent_patterns(sequence_database, min_support, 
+                                                               min_length, max_length, &profile);
+                filter_by_closure(top_patterns, closure, true);
+            }
+            if (top_patterns.size() > capacity) top_patterns.resize(capacity);
+        } else if (engine == MiningEngine::SuffixAutomaton) {
+            if (!noncontiguous_only) {
+                top_patterns = automaton.get_top_k_patterns(sequence_database, capacity, min_support, 
+                                                            min_length, max_length, &profile);
+            }
+        } else if (engine == MiningEngine::PackedNgram) {
+            if (!noncontiguous_only) {
+                top_patterns = ngram_index.get_top_k_patterns(capacity, min_support, &profile);
+            }
+        } else if (engine == MiningEngine::VerticalBitmap) {
+            TopKCollector top_k(capacity, min_support);
+            top_patterns = bitmap_index.get_frequent_patterns(min_support, min_length, max_length, 
+                                                              noncontiguous_only, &top_k, &profile);
+        } else {
+            top_patterns = trie.get_top_k_patterns(capacity, min_support, noncontiguous_only, closure, 
+                                                   &profile);
+        }
+        auto extracted_time = high_resolution_clock::now();
+        
+        vector<PatternInfo> patterns = to_pattern_infos(top_patterns);
+        
+        record_query(profile, start_time, refreshed_time, extracted_time, patterns.size());
+        return patterns;
+    }
+    
+    // Approximate mine_frequent_patterns: mines growing uniform samples of the
+    // sequences (see SamplingOptions) and scales each count by sequences / draws,
+    // with a normal-approximation confidence interval. The sample's threshold is
+    // lowered by the interval margin, and only patterns whose upper bound reaches
+    // min_support are reported. Once a round's sample would reach the database
+    // size the query is answered exactly instead. Closure is not supported.
+    // Mostly useful for the engines that mine at query time: the Trie engine's
+    // full index already exists, while sampling re-indexes every round.
+    SampledMiningResult mine_frequent_patterns_sampled(int min_support, bool noncontiguous_only, 
+                                                       const SamplingOptions& options = SamplingOptions()) {
+        return mine_sampled(numeric_limits<size_t>::max(), min_support, noncontiguous_only, options);
+    }
+    
+    // Approximate find_top_k_patterns; the k patterns of each sample that rank
+    // highest, estimated as in mine_frequent_patterns_sampled but from a second,
+    // independent sample, so being picked for ranking high does not inflate them
+    SampledMiningResult find_top_k_patterns_sampled(int k, int min_support, bool noncontiguous_only, 
+                                                    const SamplingOptions& options = SamplingOptions()) {
+        return mine_sampled(static_cast<size_t>(max(k, 0)), min_support, noncontiguous_only, options);
+    }
+    
+    // Streams the patterns mine_frequent_patterns would return to sink(const PatternView&)
+    // without building PatternInfo results or touching the result cache. The Trie
+    // engine feeds the sink straight from its traversal, in token order rather
+    // than ranked; the other engines mine first and stream in ranking order.
+    // Returns the number of patterns streamed.
+    template <typename Sink>
+    size_t export_frequent_patterns(Sink& sink, int min_support = 2, bool noncontiguous_only = false, 
+                                    PatternClosure closure = PatternClosure::All) {
+        auto start_time = high_resolution_clock::now();
+        min_support = max(min_support, 1);
+        refresh_engine_index();
+        auto refreshed_time = high_resolution_clock::now();
+        
+        QueryProfile profile;
+        size_t exported = 0;
+        if (engine == MiningEngine::Trie) {
+            trie.for_each_frequent_pattern(min_support, noncontiguous_only, closure, 
+                                           [&](const vector<TokenId>& tokens, int frequency, bool is_noncontiguous) {
+                sink(PatternView{tokens.data(), tokens.size(), frequency, is_noncontiguous, &symbols});
+                exported++;
+            }, &profile);
+        } else {
+            for (const PatternCount& p : extract_frequent_patterns(min_support, noncontiguous_only, closure, profile)) {
+                const vector<TokenId>& tokens = get<0>(p);
+                sink(PatternView{tokens.data(), tokens.size(), get<1>(p), get<2>(p), &symbols});
+                exported++;
+            }
+        }
+        
+        auto end_time = high_resolution_clock::now();
+        record_query(profile, start_time, refreshed_time, end_time, exported);
+        return exported;
+    }
+    
+    map<string, int> analyze_pattern_distribution() {
+        auto patterns = mine_frequent_patterns(1);
+        
+        map<string, int> length_distribution;
+        map<string, int> frequency_distribution;
+        
+        for (const auto& pattern : patterns) {
+            length_distribution["length_" + to_string(pattern.length)]++;
+            frequency_distribution["freq_" + to_string(pattern.frequency)]++;
+        }
+        
+        map<string, int> result;
+        result["total_unique_patterns"] = static_cast<int>(patterns.size());
+        
+        // Add distributions
+        for (const auto& dist_pair : length_distribution) {
+            result[dist_pair.first] = dist_pair.second;
+        }
+        
+        return result;
+    }
+    
+    MiningStatistics get_mining_statistics() {
+        statistics.engine = engine_name(engine);
+        statistics.node_count = statistics.edge_count = statistics.index_bytes = 0;
+        if (engine == MiningEngine::Trie) {
+            TrieMemoryReport memory = trie.memory_report();
+            statistics.node_count = memory.node_count;
+            statistics.edge_count = memory.edge_count;
+            statistics.index_bytes = memory.node_bytes + memory.edge_bytes + memory.position_bytes;
+        } else if (engine == MiningEngine::SuffixAutomaton) {
+            statistics.node_count = automaton.state_count();
+            statistics.edge_count = automaton.transition_count();
+            statistics.index_bytes = automaton.memory_bytes();
+        } else if (engine == MiningEngine::VerticalBitmap) {
+            statistics.index_bytes = bitmap_index.memory_bytes();
+        } else if (engine == MiningEngine::PackedNgram) {
+            statistics.node_count = ngram_index.entry_count();
+            statistics.index_bytes = ngram_index.memory_bytes();
+        }
+        
+        // Each folded copy skipped a trie pass costing about the average pass; the
+        // rebuilt engines scale their last rebuild by the copies they skipped
+        statistics.distinct_sequences = static_cast<int>(sequence_database.size());
+        const IndexProfile& indexing = statistics.indexing;
+        if (engine == MiningEngine::Trie) {
+            statistics.dedup_saved_time = indexing.passes == 0 ? 0.0 : 
+                (indexing.generation_time + indexing.insertion_time) / indexing.passes * indexing.folded_copies;
+        } else {
+            statistics.dedup_saved_time = statistics.distinct_sequences == 0 ? 0.0 : 
+                statistics.index_refresh_time * (statistics.total_sequences - statistics.distinct_sequences) / 
+                statistics.distinct_sequences;
+        }
+        return statistics;
+    }
+    
+    void print_statistics() {
+        cout << "\n=== Mining Statistics ===" << endl;
+        cout << "Total sequences: " << statistics.total_sequences << endl;
+        cout << "Total patterns found: " << statistics.total_patterns_found << endl;
+        cout << "Mining time: " << fixed << setprecision(4) << statistics.mining_time << " ms" 
+             << " (extraction " << statistics.extraction_time << ", sort " << statistics.sort_time 
+             << ", PatternInfo " << statistics.pattern_info_time << ")" << endl;
+        cout << "Candidates: " << statistics.candidates_generated << " checked, " 
+             << statistics.candidates_kept << " kept" << endl;
+        cout << "Result cache: " << statistics.cache_hits << " hits, " 
+             << statistics.cache_misses << " misses" << endl;
+        if (engine == MiningEngine::Trie) {
+            cout << "Indexing: " << statistics.indexing.subsequences << " subsequences (generation " 
+                 << statistics.indexing.generation_time << " ms, insertion " 
+                 << statistics.indexing.insertion_time << " ms)" << endl;
+            cout << "Distinct patterns: " << trie.get_pattern_count() << endl;
+            
+            TrieMemoryReport memory = trie.memory_report();
+            cout << "Trie nodes: " << memory.node_count << " (" << fixed << setprecision(1) 
+                 << memory.bytes_per_node << " bytes/node, shared_ptr layout ~" 
+                 << memory.legacy_bytes_per_node << " bytes/node)" << endl;
+        } else if (engine == MiningEngine::VerticalBitmap) {
+            cout << "Bitmap kernels: " << VerticalBitmapIndex::kernel_name() << endl;
+        } else if (engine == MiningEngine::PackedNgram) {
+            cout << "N-gram table: " << ngram_index.entry_count() << " entries, " 
+                 << ngram_index.shape_name() << endl;
+        }
+        if (deduplicate) {
+            get_mining_statistics();
+            cout << "Deduplication: " << statistics.distinct_sequences << " distinct sequences (" 
+                 << fixed << setprecision(2) << statistics.dedup_ratio() << "x), ~" 
+                 << statistics.dedup_saved_time << " ms saved" << endl;
+        }
+        
+        if (statistics.total_sequences > 0) {
+            double avg_seq_len = 0.0;
+            for (const auto& seq : sequence_database) {
+                avg_seq_len += static_cast<double>(seq.length) * seq.weight;
+            }
+            avg_seq_len /= statistics.total_sequences;
+            cout << "Average sequence length: " << fixed << setprecision(2) << avg_seq_len << endl;
+        }
+    }
+};
+
+// Space-Saving summary (Metwally et al.) over weighted pattern occurrences.
+// At most capacity counters are kept; an unmonitored pattern evicts the
+// smallest counter and inherits its count as error. Every count is then an
+// overestimate by at most error <= total_weight / capacity, and any pattern
+// whose true weight exceeds that bound is guaranteed to be monitored.
+class SpaceSavingSummary {
+private:
+    struct Counter {
+        string key;  // pattern tokens as raw bytes
+        double count;
+        double error;
+        double noncontiguous_count;
+    };
+    
+    size_t capacity;
+    double total_weight;
+    vector<Counter> counters;
+    unordered_map<string, size_t> slots;
+    set<pair<double, size_t>> by_count;  // (count, slot), smallest first
+    
+public:
+    explicit SpaceSavingSummary(size_t cap = 1024) : capacity(max<size_t>(cap, 1)), total_weight(0.0) {}
+    
+    static string make_key(const TokenId* tokens, size_t length) {
+        return string(reinterpret_cast<const char*>(tokens), length * sizeof(TokenId));
+    }
+    
+    static vector<TokenId> key_tokens(const string& key) {
+        vector<TokenId> tokens(key.size() / sizeof(TokenId));
+        memcpy(tokens.data(), key.data(), key.size());
+        return tokens;
+    }
+    
+    void add(const string& key, double weight, double noncontiguous_weight) {
+        total_weight += weight;
+        
+        auto it = slots.find(key);
+        if (it != slots.end()) {
+            Counter& c = counters[it->second];
+            by_count.erase({c.count, it->second});
+            c.count += weight;
+            c.noncontiguous_count += noncontiguous_weight;
+            by_count.insert({c.count, it->second});
+            return;
+        }
+        
+        if (counters.size() < capacity) {
+            size_t slot = counters.size();
+            counters.push_back({key, weight, 0.0, noncontiguous_weight});
+            slots.emplace(key, slot);
+            by_count.insert({weight, slot});
+            return;
+        }
+        
+        // Replace the minimum counter
+        size_t slot = by_count.begin()->second;
+        Counter& victim = counters[slot];
+        double floor = victim.count;
+        by_count.erase(by_count.begin());
+        slots.erase(victim.key);
+        victim = {key, floor + weight, floor, noncontiguous_weight};
+        slots.emplace(key, slot);
+        by_count.insert({victim.count, slot});
+    }
+    
+    // Multiplies every count by factor (> 0), preserving order; used to renormalize decay
+    void scale(double factor) {
+        total_weight *= factor;
+        by_count.clear();
+        for (size_t slot = 0; slot < counters.size(); ++slot) {
+            counters[slot].count *= factor;
+            counters[slot].error *= factor;
+            counters[slot].noncontiguous_count *= factor;
+            by_count.insert({counters[slot].count, slot});
+        }
+    }
+    
+    // Upper bound on the count of any pattern that is not monitored
+    double unmonitored_bound() const {
+        return counters.size() < capacity || by_count.empty() ? 0.0 : by_count.begin()->first;
+    }
+    
+    double get_total_weight() const { return total_weight; }
+    size_t size() const { return counters.size(); }
+    
+    template <typename Visitor>
+    void for_each(Visitor visit) const {
+        for (const Counter& c : counters) visit(c.key, c.count, c.error, c.noncontiguous_count);
+    }
+};
+
+// How a StreamingSubsequenceMiner forgets old sequences
+enum class StreamWindow {
+    Count,  // the last window_size sequences
+    Time,   // sequences with timestamp > now - window_size
+    Decay   // every sequence, weighted by decay^(sequences since it arrived)
+};
+
+// A streaming top-k answer: the true count lies in [frequency - error, frequency]
+struct StreamPatternEstimate {
+    vector<string> pattern;
+    string pattern_string;
+    double frequency;
+    double error;
+    bool is_noncontiguous;
+    
+    StreamPatternEstimate(vector<string> p, string p_str, double freq, double err, bool non_contig)
+        : pattern(move(p)), pattern_string(move(p_str)), frequency(freq), error(err), 
+          is_noncontiguous(non_contig) {}
+};
+
+// Mines an unbounded stream of sequences in bounded memory. Occurrences are
+// generated exactly as the trie indexes them and fed to Space-Saving counters.
+// Sliding windows are split into panes with one summary each; a pane is
+// dropped whole once it leaves the window, so the answer covers the panes
+// still in it (at most one pane more than the window). Decay mode keeps one
+// summary in which each sequence weighs 1/decay times the previous one. Memory is bounded by
+// panes * capacity counters plus the symbol table.
+class StreamingSubsequenceMiner {
+private:
+    struct Pane {
+        SpaceSavingSummary summary;
+        double start;      // first sequence number or timestamp in the pane
+        size_t sequences;
+        
+        Pane(size_t capacity, double s) : summary(capacity), start(s), sequences(0) {}
+    };
+    
+    int min_length;
+    int max_length;
+    GapConstraints gap_constraints;
+    StreamWindow window;
+    double window_size;
+    size_t pane_count;
+    size_t capacity;
+    double decay;
+    SymbolTable symbols;
+    deque<Pane> panes;
+    long long sequences_seen;
+    double last_timestamp;
+    double decay_weight;  // weight of the newest sequence in Decay mode
+    
+    double pane_span() const { return window_size / pane_count; }
+    
+    void expire(double now) {
+        // A pane may go once everything in it is older than the window
+        while (panes.size() > 1 && panes[1].start <= now - window_size) {
+            panes.pop_front();
+        }
+    }
+    
+public:
+    // window_size is a sequence count (Count), a timestamp span (Time) or ignored (Decay)
+    StreamingSubsequenceMiner(int min_len, int max_len, StreamWindow mode, double size, 
+                              size_t counters_per_pane = 4096, size_t panes_per_window = 8, 
+                              double decay_factor = 0.999)
+        : min_length(min_len), max_length(max_len), window(mode), window_size(max(size, 1.0)), 
+          pane_count(mode == StreamWindow::Decay ? 1 : max<size_t>(panes_per_window, 1)), 
+          capacity(counters_per_pane), decay(decay_factor), sequences_seen(0), last_timestamp(0.0), 
+          decay_weight(1.0) {}
+    
+    // Same meaning as AdvancedSubsequenceMiner::set_gap_constraints; applies to
+    // sequences added afterwards
+    void set_gap_constraints(const GapConstraints& constraints) { gap_constraints = constraints.normalized(); }
+    
+    // Consumes one sequence. Time windows need non-decreasing timestamps; the
+    // other modes ignore timestamp.
+    void add_sequence(const vector<string>& sequence, double timestamp = 0.0) {
+        double now = window == StreamWindow::Time ? max(timestamp, last_timestamp) 
+                                                  : static_cast<double>(sequences_seen);
+        last_timestamp = now;
+        
+        double weight = 1.0;
+        if (window == StreamWindow::Decay) {
+            // Forward decay: newer sequences get larger weights instead of
+            // rescaling every counter; renormalize before the weights overflow
+            if (panes.empty()) panes.emplace_back(capacity, now);
+            if (sequences_seen > 0) decay_weight /= decay;
+            if (decay_weight > 1e100) {
+                panes.front().summary.scale(1.0 / decay_weight);
+                decay_weight = 1.0;
+            }
+            weight = decay_weight;
+        } else {
+            expire(now);
+            if (panes.empty() || now >= panes.back().start + pane_span()) {
+                double start = panes.empty() ? now 
+                             : panes.back().start + floor((now - panes.back().start) / pane_span()) * pane_span();
+                panes.emplace_back(capacity, start);
+                expire(now);
+            }
+        }
+        
+        // Aggregate the sequence's occurrences first so each pattern is one update
+        unordered_map<string, pair<int, int>> local;  // key -> (count, non-contiguous count)
+        for_each_subsequence(symbols.encode(sequence), min_length, max_length, 
+                             [&](const TokenId* tokens, size_t length, int, bool is_noncontiguous) {
+            auto& counts = local[SpaceSavingSummary::make_key(tokens, length)];
+            counts.first++;
+            if (is_noncontiguous) counts.second++;
+        }, gap_constraints);
+        
+        Pane& pane = panes.back();
+        for (const auto& entry : local) {
+            pane.summary.add(entry.first, weight * entry.second.first, weight * entry.second.second);
+        }
+        pane.sequences++;
+        sequences_seen++;
+    }
+    
+    // Current top-k by estimated frequency. Counts from all live panes are
+    // summed; a pane that does not monitor a pattern contributes its
+    // unmonitored bound to both the estimate and the error. Patterns that no
+    // pane monitors are not reported; their true count is below error_bound().
+    vector<StreamPatternEstimate> get_top_k(size_t k, double min_support = 1.0, 
+                                            bool noncontiguous_only = false) const {
+        struct Merged {
+            double count = 0.0;
+            double error = 0.0;
+            double noncontiguous = 0.0;
+        };
+        unordered_map<string, Merged> merged;
+        double unmonitored_total = 0.0;
+        double scale_out = 1.0 / decay_weight;
+        
+        for (const Pane& pane : panes) {
+            unmonitored_total += pane.summary.unmonitored_bound();
+            pane.summary.for_each([&](const string& key, double count, double error, double nc) {
+                Merged& m = merged[key];
+                m.count += count - pane.summary.unmonitored_bound();
+                m.error += error - pane.summary.unmonitored_bound();
+                m.noncontiguous += nc;
+            });
+        }
+        
+        vector<pair<string, Merged>> ranked;
+        for (auto& entry : merged) {
+            Merged& m = entry.second;
+            // Panes missing the pattern may each hide up to their unmonitored bound
+            m.count = (m.count + unmonitored_total) * scale_out;
+            m.error = (m.error + unmonitored_total) * scale_out;
+            m.noncontiguous *= scale_out;
+            if (m.count < min_support) continue;
+            if (noncontiguous_only && m.noncontiguous <= 0.0) continue;
+            ranked.emplace_back(entry.first, m);
+        }
+        
+        sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) {
+            if (a.second.count != b.second.count) return a.second.count > b.second.count;
+            return a.first < b.first;
+        });
+        if (ranked.size() > k) ranked.resize(k);
+        
+        vector<StreamPatternEstimate> result;
+        result.reserve(ranked.size());
+        for (const auto& entry : ranked) {
+            vector<string> pattern = symbols.decode(SpaceSavingSummary::key_tokens(entry.first));
+            string pattern_string;
+            for (size_t i = 0; i < pattern.size(); ++i) {
+                if (i > 0) pattern_string += " -> ";
+                pattern_string += pattern[i];
+            }
+            result.emplace_back(move(pattern), move(pattern_string), entry.second.count, 
+                                entry.second.error, entry.second.noncontiguous > 0.0);
+        }
+        return result;
+    }
+    
+    // Largest overestimate any reported frequency can carry right now
+    double error_bound() const {
+        double bound = 0.0;
+        for (const Pane& pane : panes) bound += pane.summary.get_total_weight() / capacity;
+        return bound / decay_weight;
+    }
+    
+    // Sequences (or decayed sequence weight) the current answer covers
+    double window_sequences() const {
+        if (window == StreamWindow::Decay) {
+            if (decay >= 1.0) return static_cast<double>(sequences_seen);
+            return (1.0 - pow(decay, static_cast<double>(sequences_seen))) / (1.0 - decay);
+        }
+        double covered = 0.0;
+        for (const Pane& pane : panes) covered += pane.sequences;
+        return covered;
+    }
+    
+    long long get_sequences_seen() const { return sequences_seen; }
+    size_t counter_count() const {
+        size_t total = 0;
+        for (const Pane& pane : panes) total += pane.summary.size();
+        return total;
+    }
+};
+
+// Outcome of a PartitionedMiner run
+struct PartitionedMiningStatistics {
+    bool success;
+    string error;
+    size_t partitions;
+    size_t sequences;
+    size_t candidates;            // distinct locally frequent patterns after the merge
+    size_t peak_partition_bytes;  // largest estimated partition footprint
+    double partition_time;        // pass 1: index and mine every partition
+    double merge_time;            // merge the spilled candidate runs
+    double count_time;            // pass 2: exact counts for the candidates
+    
+    PartitionedMiningStatistics() : success(false), partitions(0), sequences(0), candidates(0), 
+                                    peak_partition_bytes(0), 
+                                    partition_time(0.0), merge_time(0.0), count_time(0.0) {}
+};
+
+// Current resident set in bytes, or 0 where /proc is unavailable
+size_t current_rss_bytes() {
+    ifstream statm("/proc/self/statm");
+    size_t total_pages = 0, resident_pages = 0;
+    if (!(statm >> total_pages >> resident_pages)) return 0;
+    return resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// Out-of-core miner for event logs larger than memory, after the SON partition
+// algorithm. Pass 1 cuts the input into partitions that fit half the memory
+// budget and mines each with the support threshold scaled to its share of the
+// input; a pattern frequent overall must be frequent in some partition, so the
+// spilled candidate runs, once merged, contain every answer. Pass 2 re-indexes
+// each partition and adds up the candidates' exact counts, which are therefore
+// the same as mining the whole file in memory. Only the vocabulary, one
+// partition and one block of candidates are resident at a time.
+// The budget covers the whole process: the resident size when mine() starts
+// is set aside, and the rest is split between the partition (half, less the
+// vocabulary) and the candidate buffer or pass-2 block (a quarter each).
+class PartitionedMiner {
+private:
+    struct Partition {
+        size_t sequences;
+        size_t bytes;
+    };
+    
+    struct CandidateCount {
+        int32_t frequency;
+        uint32_t noncontiguous;
+    };
+    
+    // Sequential reader over a file of length-prefixed patterns
+    struct RunReader {
+        ifstream in;
+        vector<uint32_t> pattern;  // length, then the global token ids
+        
+        explicit RunReader(const string& path) : in(path, ios::binary) {}
+        
+        bool next() {
+            uint32_t length;
+            if (!in.read(reinterpret_cast<char*>(&length), sizeof(length))) return false;
+            pattern.resize(length + 1);
+            pattern[0] = length;
+            return static_cast<bool>(in.read(reinterpret_cast<char*>(pattern.data() + 1), 
+                                             length * sizeof(uint32_t)));
+        }
+    };
+    
+    static constexpr size_t INDEX_BATCH = 1024;        // most sequences indexed between budget checks
+    static constexpr size_t PROBE_BATCH = 16;          // first batch, before the cost per sequence is known
+    static constexpr size_t MIN_WORKING_BYTES = 1 << 20;  // least budget left beyond the baseline
+    static constexpr size_t SEQUENCE_OVERHEAD = 96;    // database bytes per sequence besides tokens
+    static constexpr size_t LOOKUP_BYTES = 256;        // pass-2 working memory per candidate in a block
+    // A trie node with its share of the edge pool, whose slots are at most twice the edges
+    static constexpr size_t NODE_BYTES = sizeof(TrieNode) + 2 * sizeof(TrieEdge);
+    
+    int min_length;
+    int max_length;
+    int num_threads;
+    size_t memory_budget;
+    size_t working_budget;         // memory_budget less the process's resident size at mine()
+    string temp_root;
+    GapConstraints gap_constraints;
+    SymbolTable symbols;           // global ids shared by every partition's candidates
+    string work_dir;
+    vector<string> temp_files;
+    vector<uint32_t> candidate_buffer;  // length-prefixed patterns awaiting a spill
+    vector<string> run_paths;
+    string candidates_path;        // merged candidates of the last mine()
+    string counts_path;            // their global counts, one CandidateCount each
+    int min_support;
+    
+    static bool pattern_less(const uint32_t* a, const uint32_t* b) {
+        return lexicographical_compare(a + 1, a + 1 + a[0], b + 1, b + 1 + b[0]);
+    }
+    
+    static void split_line(const string& line, vector<string>& tokens) {
+        tokens.clear();
+        size_t i = 0;
+        while (i < line.size()) {
+            while (i < line.size() && (line[i] == ' ' || line[i] == '\t' || line[i] == '\r')) ++i;
+            size_t start = i;
+            while (i < line.size() && line[i] != ' ' && line[i] != '\t' && line[i] != '\r') ++i;
+            if (i > start) tokens.emplace_back(line, start, i - start);
+        }
+    }
+    
+    // Bytes one partition's index and sequences may take
+    size_t partition_limit() const {
+        size_t vocabulary = symbols.memory_bytes();
+        return working_budget / 2 > vocabulary ? working_budget / 2 - vocabulary : 1;
+    }
+    
+    unique_ptr<AdvancedSubsequenceMiner> make_partition_miner() const {
+        auto miner = make_unique<AdvancedSubsequenceMiner>(min_length, max_length, num_threads);
+        miner->set_position_tracking(false);
+        miner->set_result_caching(false);
+        miner->set_gap_constraints(gap_constraints);
+        // Reserved up front, so the index never doubles past the limit mid-batch
+        miner->reserve_index(partition_limit() / NODE_BYTES + 1);
+        return miner;
+    }
+    
+    string temp_path(const string& name) {
+        temp_files.push_back(work_dir + "/" + name);
+        return temp_files.back();
+    }
+    
+    void remove_temp_files() {
+        for (const string& path : temp_files) unlink(path.c_str());
+        temp_files.clear();
+        run_paths.clear();
+        candidates_path.clear();
+        counts_path.clear();
+        if (!work_dir.empty()) rmdir(work_dir.c_str());
+        work_dir.clear();
+    }
+    
+    // Indexes sequences from in until the partition's estimated footprint would
+    // pass partition_limit(), or with fixed_count > 0 until that many are read.
+    // Pass 2 replays pass 1's counts so both see the same partitions. Batches
+    // are sized from the cost per sequence so far to at most half the room
+    // left, so a partition overshoots the limit by at most about one sequence,
+    // and the per-thread shards of one batch stay small beside the limit.
+    Partition read_partition(istream& in, AdvancedSubsequenceMiner& miner, size_t fixed_count, 
+                             size_t& footprint) const {
+        Partition partition{0, 0};
+        size_t limit = partition_limit();
+        size_t database_bytes = 0;
+        size_t batch_size = PROBE_BATCH;
+        vector<vector<string>> batch;
+        vector<string> tokens;
+        string line;
+        footprint = 0;
+        
+        while (fixed_count == 0 || partition.sequences + batch.size() < fixed_count) {
+            if (!getline(in, line)) break;
+            partition.bytes += line.size() + 1;
+            split_line(line, tokens);
+            if (tokens.empty()) continue;
+            database_bytes += SEQUENCE_OVERHEAD + tokens.size() * sizeof(TokenId);
+            batch.push_back(move(tokens));
+            
+            if (batch.size() >= batch_size) {
+                miner.add_sequences(batch);
+                partition.sequences += batch.size();
+                batch.clear();
+                footprint = database_bytes + miner.get_mining_statistics().node_count * NODE_BYTES;
+                
+                size_t per_sequence = max<size_t>(footprint / partition.sequences, 1);
+                if (fixed_count == 0 && footprint + per_sequence > limit) break;
+                size_t room = footprint < limit ? limit - footprint : 0;
+                batch_size = min(max<size_t>(room / per_sequence / 2, 1), INDEX_BATCH);
+            }
+        }
+        if (!batch.empty()) {
+            miner.add_sequences(batch);
+            partition.sequences += batch.size();
+        }
+        footprint = database_bytes + miner.get_mining_statistics().node_count * NODE_BYTES;
+        return partition;
+    }
+    
+    // Sorts the buffered candidates and writes them out as one run
+    bool spill_candidates(string& error) {
+        if (candidate_buffer.empty()) return true;
+        
+        vector<size_t> offsets;
+        for (size_t offset = 0; offset < candidate_buffer.size(); offset += candidate_buffer[offset] + 1) {
+            offsets.push_back(offset);
+        }
+        const uint32_t* base = candidate_buffer.data();
+        sort(offsets.begin(), offsets.end(), [base](size_t a, size_t b) {
+            return pattern_less(base + a, base + b);
+        });
+        
+        string path = temp_path("run" + to_string(run_paths.size()));
+        ofstream out(path, ios::binary);
+        for (size_t offset : offsets) {
+            out.write(reinterpret_cast<const char*>(base + offset), 
+                      (candidate_buffer[offset] + 1) * sizeof(uint32_t));
+        }
+        if (!out) {
+            error = "cannot write " + path;
+            return false;
+        }
+        run_paths.push_back(path);
+        candidate_buffer.clear();
+        return true;
+    }
+    
+    // K-way merges the runs into one sorted file of distinct candidates
+    bool merge_runs(const string& path, size_t& candidates, string& error) {
+        vector<unique_ptr<RunReader>> readers;
+        for (const string& run : run_paths) {
+            readers.push_back(make_unique<RunReader>(run));
+            if (!readers.back()->in) {
+                error = "cannot read " + run;
+                return false;
+            }
+        }
+        
+        auto heap_order = [&](size_t a, size_t b) {
+            return pattern_less(readers[b]->pattern.data(), readers[a]->pattern.data());
+        };
+        priority_queue<size_t, vector<size_t>, decltype(heap_order)> heap(heap_order);
+        for (size_t i = 0; i < readers.size(); ++i) {
+            if (readers[i]->next()) heap.push(i);
+        }
+        
+        ofstream out(path, ios::binary);
+        vector<uint32_t> previous;
+        candidates = 0;
+        while (!heap.empty()) {
+            size_t i = heap.top();
+            heap.pop();
+            vector<uint32_t>& pattern = readers[i]->pattern;
+            if (candidates == 0 || pattern != previous) {
+                out.write(reinterpret_cast<const char*>(pattern.data()), pattern.size() * sizeof(uint32_t));
+                previous = pattern;
+                candidates++;
+            }
+            if (readers[i]->next()) heap.push(i);
+        }
+        if (!out) {
+            error = "cannot write " + path;
+            return false;
+        }
+        
+        // The runs are no longer needed; free their disk space early
+        for (const string& run : run_paths) unlink(run.c_str());
+        return true;
+    }
+    
+    // Adds one partition's counts for every candidate into the counts file
+    bool count_partition(const AdvancedSubsequenceMiner& miner, const string& candidates_path, 
+                         fstream& counts, string& error) const {
+        RunReader reader(candidates_path);
+        size_t block_size = max<size_t>(working_budget / 4 / LOOKUP_BYTES, 64);
+        vector<vector<string_view>> queries;
+        vector<CandidateCount> block_counts;
+        size_t first = 0;
+        
+        while (true) {
+            size_t n = 0;
+            while (n < block_size && reader.next()) {
+                if (queries.size() == n) queries.emplace_back();
+                queries[n].clear();
+                for (uint32_t j = 1; j <= reader.pattern[0]; ++j) {
+                    queries[n].push_back(symbols.decode(reader.pattern[j]));
+                }
+                n++;
+            }
+            if (n == 0) break;
+            queries.resize(n);
+            vector<pair<int, bool>> found = miner.count_patterns(queries);
+            
+            block_counts.resize(n);
+            streamoff offset = static_cast<streamoff>(first * sizeof(CandidateCount));
+            streamsize bytes = static_cast<streamsize>(block_counts.size() * sizeof(CandidateCount));
+            counts.seekg(offset);
+            counts.read(reinterpret_cast<char*>(block_counts.data()), bytes);
+            for (size_t i = 0; i < found.size(); ++i) {
+                block_counts[i].frequency += found[i].first;
+                if (found[i].second) block_counts[i].noncontiguous = 1;
+            }
+            counts.seekp(offset);
+            counts.write(reinterpret_cast<const char*>(block_counts.data()), bytes);
+            if (!counts) {
+                error = "cannot update candidate counts";
+                return false;
+            }
+            first += n;
+        }
+        return true;
+    }
+    
+    PartitionedMiningStatistics run(const string& path) {
+        PartitionedMiningStatistics result;
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) {
+            result.error = "cannot open " + path + ": " + strerror(errno);
+            return result;
+        }
+        // One extra byte covers a final line without a newline, so the
+        // partitions' shares never add up to more than 1
+        double total_bytes = static_cast<double>(info.st_size) + 1.0;
+        
+        size_t baseline = current_rss_bytes();
+        if (memory_budget < baseline + MIN_WORKING_BYTES) {
+            result.error = "memory budget of " + to_string(memory_budget / 1048576) + 
+                           " MB leaves no room beyond the process's own " + 
+                           to_string((baseline + 1048575) / 1048576) + " MB";
+            return result;
+        }
+        working_budget = memory_budget - baseline;
+        
+        string pattern_dir = temp_root + "/subsequence-XXXXXX";
+        vector<char> dir_name(pattern_dir.begin(), pattern_dir.end());
+        dir_name.push_back('\0');
+        if (!mkdtemp(dir_name.data())) {
+            result.error = "cannot create a directory in " + temp_root + ": " + strerror(errno);
+            return result;
+        }
+        work_dir = dir_name.data();
+        
+        // Pass 1: mine each partition with a proportional local threshold
+        auto start_time = high_resolution_clock::now();
+        ifstream in(path);
+        vector<Partition> partitions;
+        size_t buffer_limit = max<size_t>(working_budget / 4 / sizeof(uint32_t), 1024);
+        while (true) {
+            unique_ptr<AdvancedSubsequenceMiner> miner = make_partition_miner();
+            size_t footprint;
+            Partition partition = read_partition(in, *miner, 0, footprint);
+            if (partition.sequences == 0) break;
+            partitions.push_back(partition);
+            result.sequences += partition.sequences;
+            result.peak_partition_bytes = max(result.peak_partition_bytes, footprint);
+            
+            // floor() can only lower the threshold, which keeps the pass complete
+            int local_support = max(1, static_cast<int>(min_support * (partition.bytes / total_bytes)));
+            bool spilled = true;
+            auto collect = [&](const PatternView& pattern) {
+                candidate_buffer.push_back(static_cast<uint32_t>(pattern.length));
+                for (size_t i = 0; i < pattern.length; ++i) {
+                    candidate_buffer.push_back(symbols.intern(pattern.token(i)));
+                }
+                if (candidate_buffer.size() >= buffer_limit) spilled = spilled && spill_candidates(result.error);
+            };
+            miner->export_frequent_patterns(collect, local_support);
+            if (!spilled || !spill_candidates(result.error)) return result;
+        }
+        if (in.bad()) {
+            result.error = "error reading " + path;
+            return result;
+        }
+        result.partitions = partitions.size();
+        result.partition_time = elapsed_ms(start_time);
+        // Pass 2's lookup blocks reuse the buffer's quarter of the budget
+        candidate_buffer.clear();
+        candidate_buffer.shrink_to_fit();
+        
+        start_time = high_resolution_clock::now();
+        string merged_path = temp_path("candidates");
+        if (!merge_runs(merged_path, result.candidates, result.error)) return result;
+        result.merge_time = elapsed_ms(start_time);
+        
+        // Pass 2: exact counts, accumulated in a file parallel to the candidates
+        start_time = high_resolution_clock::now();
+        string totals_path = temp_path("counts");
+        {
+            ofstream zeros(totals_path, ios::binary);
+            vector<CandidateCount> block(1024, CandidateCount{0, 0});
+            for (size_t written = 0; written < result.candidates; written += block.size()) {
+                size_t n = min(block.size(), result.candidates - written);
+                zeros.write(reinterpret_cast<const char*>(block.data()), n * sizeof(CandidateCount));
+            }
+            if (!zeros) {
+                result.error = "cannot write " + totals_path;
+                return result;
+            }
+        }
+        fstream counts(totals_path, ios::in | ios::out | ios::binary);
+        in.clear();
+        in.seekg(0);
+        for (const Partition& partition : partitions) {
+            unique_ptr<AdvancedSubsequenceMiner> miner = make_partition_miner();
+            size_t footprint;
+            read_partition(in, *miner, partition.sequences, footprint);
+            if (!count_partition(*miner, merged_path, counts, result.error)) return result;
+        }
+        result.count_time = elapsed_ms(start_time);
+        
+        candidates_path = merged_path;
+        counts_path = totals_path;
+        result.success = true;
+        return result;
+    }
+    
+public:
+    // memory_budget_bytes is for the whole process, including what it already
+    // holds when mine() is called; mine() fails if that leaves under 1 MB
+    PartitionedMiner(int min_len, int max_len, size_t memory_budget_bytes, int threads = 1, 
+                     string temp_directory = "/tmp")
+        : min_length(min_len), max_length(max_len), num_threads(max(threads, 1)), 
+          memory_budget(memory_budget_bytes), working_budget(0), temp_root(move(temp_directory)), 
+          min_support(1) {}
+    
+    ~PartitionedMiner() { remove_temp_files(); }
+    
+    PartitionedMiner(const PartitionedMiner&) = delete;
+    PartitionedMiner& operator=(const PartitionedMiner&) = delete;
+    
+    // Same meaning as AdvancedSubsequenceMiner::set_gap_constraints
+    void set_gap_constraints(const GapConstraints& constraints) { gap_constraints = constraints.normalized(); }
+    
+    // Mines a newline-delimited file (it is read twice, so not stdin). The
+    // counted candidates stay on disk for export_frequent_patterns until the
+    // next mine() or destruction.
+    PartitionedMiningStatistics mine(const string& path, int support) {
+        remove_temp_files();
+        min_support = max(support, 1);
+        PartitionedMiningStatistics result = run(path);
+        candidate_buffer.clear();
+        candidate_buffer.shrink_to_fit();
+        if (!result.success) remove_temp_files();
+        return result;
+    }
+    
+    // Streams every pattern of the last mine() with frequency >= min_support to
+    // sink(const PatternView&) in candidate order; returns how many were sent
+    template <typename Sink>
+    size_t export_frequent_patterns(Sink& sink, bool noncontiguous_only = false) const {
+        if (candidates_path.empty()) return 0;
+        
+        RunReader reader(candidates_path);
+        ifstream totals(counts_path, ios::binary);
+        CandidateCount count;
+        size_t exported = 0;
+        while (reader.next() && totals.read(reinterpret_cast<char*>(&count), sizeof(count))) {
+            if (count.frequency < min_support) continue;
+            if (noncontiguous_only && !count.noncontiguous) continue;
+            sink(PatternView{reader.pattern.data() + 1, reader.pattern[0], count.frequency, 
+                             count.noncontiguous != 0, &symbols});
+            exported++;
+        }
+        return exported;
+    }
+    
+    const SymbolTable& get_symbols() const { return symbols; }
+};
+
+// Partial counts that a shard worker sends its coordinator, in a byte-order
+// independent format so workers can later run on other hosts:
+//   "SSPC", then varints: format version, shard, shard count, sequence count,
+//   symbol count; the shard's symbols in ascending byte order, each as a varint
+//   length and its bytes; the shard's patterns in ascending order of their
+//   symbol ranks, each as a varint length, that many varint ranks and a varint
+//   (frequency << 1 | non-contiguous). A zero length ends the stream, so a
+//   worker that dies midway shows up as truncation, not as missing counts.
+constexpr uint32_t PARTIAL_COUNTS_VERSION = 1;
+
+// Streams every pattern the miner holds (frequency >= 1) to fd in the partial
+// count format. Patterns are exported once into a flat buffer, their tokens
+// replaced by byte-order ranks and sorted, so the coordinator can merge shards
+// without sorting.
+bool write_partial_counts(AdvancedSubsequenceMiner& miner, int fd, size_t shard, size_t shard_count, 
+                          string* error = nullptr) {
+    SymbolTable local;
+    vector<uint32_t> records;  // length, tokens, (frequency << 1 | non-contiguous)
+    vector<size_t> offsets;
+    auto collect = [&](const PatternView& pattern) {
+        offsets.push_back(records.size());
+        records.push_back(static_cast<uint32_t>(pattern.length));
+        for (size_t i = 0; i < pattern.length; ++i) records.push_back(local.intern(pattern.token(i)));
+        records.push_back(static_cast<uint32_t>(pattern.frequency) << 1 | (pattern.is_noncontiguous ? 1 : 0));
+    };
+    miner.export_frequent_patterns(collect, 1);
+    
+    vector<TokenId> order(local.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = static_cast<TokenId>(i);
+    sort(order.begin(), order.end(), [&local](TokenId a, TokenId b) { return local.decode(a) < local.decode(b); });
+    vector<uint32_t> rank(order.size());
+    for (size_t r = 0; r < order.size(); ++r) rank[order[r]] = static_cast<uint32_t>(r);
+    for (size_t offset : offsets) {
+        for (uint32_t i = 1; i <= records[offset]; ++i) records[offset + i] = rank[records[offset + i]];
+    }
+    const uint32_t* base = records.data();
+    sort(offsets.begin(), offsets.end(), [base](size_t a, size_t b) {
+        return lexicographical_compare(base + a + 1, base + a + 1 + base[a], base + b + 1, base + b + 1 + base[b]);
+    });
+    
+    string buffer;
+    auto put_varint = [&buffer](uint64_t value) {
+        while (value >= 0x80) {
+            buffer.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        buffer.push_back(static_cast<char>(value));
+    };
+    auto drain = [&]() {
+        size_t written = 0;
+        while (written < buffer.size()) {
+            ssize_t n = write(fd, buffer.data() + written, buffer.size() - written);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                if (error) *error = string("write failed: ") + strerror(errno);
+                return false;
+            }
+            written += static_cast<size_t>(n);
+        }
+        buffer.clear();
+        return true;
+    };
+    
+    buffer.append("SSPC", 4);
+    put_varint(PARTIAL_COUNTS_VERSION);
+    put_varint(shard);
+    put_varint(shard_count);
+    put_varint(static_cast<uint64_t>(miner.get_mining_statistics().total_sequences));
+    put_varint(order.size());
+    for (TokenId id : order) {
+        const string& token = local.decode(id);
+        put_varint(token.size());
+        buffer += token;
+        if (buffer.size() >= (1 << 20) && !drain()) return false;
+    }
+    for (size_t offset : offsets) {
+        for (uint32_t i = 0; i <= records[offset]; ++i) put_varint(records[offset + i]);
+        put_varint(records[offset + records[offset] + 1]);
+        if (buffer.size() >= (1 << 20) && !drain()) return false;
+    }
+    put_varint(0);
+    return drain();
+}
+
+// Reads one partial-count stream: the header and symbols on construction,
+// then one pattern per next(), with tokens as the stream's symbol ranks
+class PartialCountReader {
+private:
+    int fd;
+    vector<char> buffer;
+    size_t position;
+    size_t filled;
+    string error;
+    bool ended;  // saw the terminating zero length
+    
+    bool get_byte(uint8_t& byte) {
+        if (position == filled) {
+            ssize_t n;
+            do {
+                n = read(fd, buffer.data(), buffer.size());
+            } while (n < 0 && errno == EINTR);
+            if (n <= 0) {
+                if (error.empty()) error = n < 0 ? string("read failed: ") + strerror(errno) : "truncated stream";
+                return false;
+            }
+            position = 0;
+            filled = static_cast<size_t>(n);
+        }
+        byte = static_cast<uint8_t>(buffer[position++]);
+        return true;
+    }
+    
+    bool get_varint(uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t byte;
+            if (!get_byte(byte)) return false;
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        error = "malformed varint";
+        return false;
+    }
+    
+public:
+    uint64_t shard;
+    uint64_t shard_count;
+    uint64_t sequence_count;
+    vector<string> symbols;     // in ascending byte order; ranks index this
+    vector<uint32_t> pattern;   // ranks of the current pattern
+    int frequency;
+    bool is_noncontiguous;
+    
+    // Does not take ownership of fd
+    explicit PartialCountReader(int input_fd) 
+        : fd(input_fd), buffer(1 << 16), position(0), filled(0), ended(false), 
+          shard(0), shard_count(0), sequence_count(0), frequency(0), is_noncontiguous(false) {
+        char magic[4];
+        for (char& c : magic) {
+            uint8_t byte;
+            if (!get_byte(byte)) return;
+            c = static_cast<char>(byte);
+        }
+        uint64_t version, symbol_count;
+        if (memcmp(magic, "SSPC", 4) != 0) {
+            error = "not a partial-count stream";
+            return;
+        }
+        if (!get_varint(version)) return;
+        if (version != PARTIAL_COUNTS_VERSION) {
+            error = "unsupported partial-count version " + to_string(version);
+            return;
+        }
+        if (!get_varint(shard) || !get_varint(shard_count) || !get_varint(sequence_count) || 
+            !get_varint(symbol_count)) return;
+        symbols.resize(symbol_count);
+        for (string& token : symbols) {
+            uint64_t length;
+            if (!get_varint(length)) return;
+            token.resize(length);
+            for (char& c : token) {
+                uint8_t byte;
+                if (!get_byte(byte)) return;
+                c = static_cast<char>(byte);
+            }
+        }
+    }
+    
+    bool is_open() const { return error.empty(); }
+    const string& get_error() const { return error; }
+    bool finished() const { return ended; }
+    
+    // Advances to the next pattern; false at the end of the stream or on error
+    bool next() {
+        if (ended || !error.empty()) return false;
+        uint64_t length, value;
+        if (!get_varint(length)) return false;
+        if (length == 0) {
+            ended = true;
+            return false;
+        }
+        pattern.resize(length);
+        for (uint32_t& rank : pattern) {
+            if (!get_varint(value)) return false;
+            if (value >= symbols.size()) {
+                error = "symbol rank out of range";
+                return false;
+            }
+            rank = static_cast<uint32_t>(value);
+        }
+        if (!get_varint(value)) return false;
+        frequency = static_cast<int>(value >> 1);
+        is_noncontiguous = (value & 1) != 0;
+        return true;
+    }
+};
+
+// Coordinator side: merges every shard's partial counts into the counts one
+// miner over all the sequences would have. The union of the shards' symbols
+// is interned in byte order, so global ids compare like the strings and each
+// stream stays sorted after remapping; a k-way merge then sums the partial
+// counts of each pattern in one pass.
+class PartialCountMerger {
+private:
+    struct Stream {
+        unique_ptr<PartialCountReader> reader;
+        vector<TokenId> remap;    // stream rank -> global id
+        vector<TokenId> current;  // current pattern in global ids
+    };
+    
+    vector<Stream> streams;
+    SymbolTable symbols;
+    uint64_t sequence_count;
+    string error;
+    
+    bool advance(Stream& stream) {
+        if (!stream.reader->next()) return false;
+        stream.current.clear();
+        for (uint32_t rank : stream.reader->pattern) stream.current.push_back(stream.remap[rank]);
+        return true;
+    }
+    
+public:
+    // Reads each descriptor's header; the caller keeps ownership of the descriptors
+    explicit PartialCountMerger(const vector<int>& fds) : sequence_count(0) {
+        vector<bool> seen;
+        for (int fd : fds) {
+            streams.push_back(Stream{make_unique<PartialCountReader>(fd), {}, {}});
+            PartialCountReader& reader = *streams.back().reader;
+            if (!reader.is_open()) {
+                error = reader.get_error();
+                return;
+            }
+            if (reader.shard_count != fds.size() || reader.shard >= fds.size() || 
+                (!seen.empty() && seen[reader.shard])) {
+                error = "streams are not shards 0.." + to_string(fds.size() - 1) + " of one split";
+                return;
+            }
+            seen.resize(fds.size());
+            seen[reader.shard] = true;
+            sequence_count += reader.sequence_count;
+        }
+        
+        vector<string_view> vocabulary;
+        for (const Stream& stream : streams) {
+            vocabulary.insert(vocabulary.end(), stream.reader->symbols.begin(), stream.reader->symbols.end());
+        }
+        sort(vocabulary.begin(), vocabulary.end());
+        vocabulary.erase(unique(vocabulary.begin(), vocabulary.end()), vocabulary.end());
+        for (string_view token : vocabulary) symbols.intern(token);
+        for (Stream& stream : streams) {
+            for (const string& token : stream.reader->symbols) {
+                TokenId id = 0;
+                symbols.find(token, id);
+                stream.remap.push_back(id);
+            }
+        }
+    }
+    
+    bool is_open() const { return error.empty(); }
+    const string& get_error() const { return error; }
+    uint64_t get_sequence_count() const { return sequence_count; }
+    const SymbolTable& get_symbols() const { return symbols; }
+    
+    // Sends every merged pattern with frequency >= min_support to
+    // sink(const PatternView&) in byte order. Returns how many were sent; a
+    // stream that ends early leaves get_error() set.
+    template <typename Sink>
+    size_t merge(Sink& sink, int min_support = 2, bool noncontiguous_only = false) {
+        if (!error.empty()) return 0;
+        
+        auto heap_order = [this](size_t a, size_t b) { return streams[b].current < streams[a].current; };
+        priority_queue<size_t, vector<size_t>, decltype(heap_order)> heap(heap_order);
+        for (size_t i = 0; i < streams.size(); ++i) {
+            if (advance(streams[i])) heap.push(i);
+        }
+        
+        vector<TokenId> pattern;
+        size_t exported = 0;
+        while (!heap.empty()) {
+            pattern = streams[heap.top()].current;
+            int frequency = 0;
+            bool is_noncontiguous = false;
+            while (!heap.empty() && streams[heap.top()].current == pattern) {
+                size_t i = heap.top();
+                heap.pop();
+                frequency += streams[i].reader->frequency;
+                is_noncontiguous = is_noncontiguous || streams[i].reader->is_noncontiguous;
+                if (advance(streams[i])) heap.push(i);
+            }
+            
+            if (frequency < min_support || (noncontiguous_only && !is_noncontiguous)) continue;
+            sink(PatternView{pattern.data(), pattern.size(), frequency, is_noncontiguous, &symbols});
+            exported++;
+        }
+        
+        for (const Stream& stream : streams) {
+            if (!stream.reader->finished()) {
+                error = "shard " + to_string(stream.reader->shard) + ": " + stream.reader->get_error();
+                break;
+            }
+        }
+        return exported;
+    }
+};
+
+// Utility functions
+vector<string> split_string(const string& str, char delimiter = ' ') {
+    vector<string> tokens;
+    stringstream ss(str);
+    string token;
+    
+    while (getline(ss, token, delimiter)) {
+        if (!token.empty()) {
+            tokens.push_back(token);
+        }
+    }
+    
+    return tokens;
+}
+
+vector<vector<string>> get_demo_data() {
+    return {
+        {"login", "browse", "search", "view_item", "add_to_cart", "checkout"},
+        {"login", "browse", "view_item", "add_to_cart", "checkout"},
+        {"browse", "search", "view_item", "browse", "view_item", "add_to_cart"},
+        {"login", "browse", "search", "view_item", "logout"},
+        {"browse", "search", "view_item", "add_to_cart", "checkout", "logout"},
+        {"login", "view_item", "add_to_cart", "checkout"},
+        {"browse", "search", "search", "view_item", "add_to_cart"}
+    };
+}
+
+vector<vector<string>> get_user_input() {
+    cout << "\n" << string(50, '=') << endl;
+    cout << "INTERACTIVE SUBSEQUENCE MINER" << endl;
+    cout << string(50, '=') << endl;
+    
+    vector<vector<string>> sequences;
+    cout << "\nEnter your sequences (space-separated elements per line)" << endl;
+    cout << "Type 'done' when finished, 'demo' for sample data:" << endl;
+    
+    string line;
+    cin.ignore(); // Clear input buffer
+    
+    while (true) {
+        cout << "Sequence " << (sequences.size() + 1) << ": ";
+        getline(cin, line);
+        
+        if (line == "done") {
+            break;
+        } else if (line == "demo") {
+            return get_demo_data();
+        } else if (!line.empty()) {
+            auto sequence = split_string(line);
+            sequences.push_back(sequence);
+            cout << "Added sequence: ";
+            for (size_t i = 0; i < sequence.size(); ++i) {
+                if (i > 0) cout << " -> ";
+                cout << sequence[i];
+            }
+            cout << endl;
+        }
+    }
+    
+    if (sequences.empty()) {
+        cout << "No sequences provided. Using demo data." << endl;
+        return get_demo_data();
+    }
+    
+    return sequences;
+}
+
+void interactive_mining() {
+    // Get sequences from user
+    auto sequences = get_user_input();
+    
+    // Get mining parameters
+    int k = 5, min_support = 2, max_length = 4;
+    char pattern_type = 'b';
+    
+    cout << "\nEnter k for top-k patterns (default 5): ";
+    string input;
+    getline(cin, input);
+    if (!input.empty()) {
+        try {
+            k = stoi(input);
+        } catch (...) {
+            cout << "Invalid input. Using default k=5." << endl;
+        }
+    }
+    
+    cout << "Enter minimum support (default 2): ";
+    getline(cin, input);
+    if (!input.empty()) {
+        try {
+            min_support = stoi(input);
+        } catch (...) {
+            cout << "Invalid input. Using default min_support=2." << endl;
+        }
+    }
+    
+    cout << "Enter maximum pattern length (default 4): ";
+    getline(cin, input);
+    if (!input.empty()) {
+        try {
+            max_length = stoi(input);
+        } catch (...) {
+            cout << "Invalid input. Using default max_length=4." << endl;
+        }
+    }
+    
+    cout << "Pattern type - (c)ontiguous, (n)on-contiguous, or (b)oth? (default: both): ";
+    getline(cin, input);
+    if (!input.empty()) {
+        pattern_type = static_cast<char>(tolower(input[0]));
+        if (pattern_type != 'c' && pattern_type != 'n' && pattern_type != 'b') {
+            pattern_type = 'b';
+        }
+    }
+    
+    // Initialize miner; non-contiguous queries use exact pattern growth
+    AdvancedSubsequenceMiner miner(2, max_length);
+    if (pattern_type == 'n') {
+        miner.set_engine(MiningEngine::PatternGrowth);
+    }
+    
+    // Add sequences
+    for (size_t i = 0; i < sequences.size(); ++i) {
+        miner.add_sequence(sequences[i], static_cast<int>(i));
+    }
+    
+    cout << "\n" << string(60, '=') << endl;
+    cout << "MINING RESULTS" << endl;
+    cout << string(60, '=') << endl;
+    cout << "Dataset: " << sequences.size() << " sequences" << endl;
+    cout << "Parameters: k=" << k << ", min_support=" << min_support 
+         << ", max_length=" << max_length << endl;
+    
+    // Mine patterns based on user preference
+    vector<PatternInfo> patterns;
+    
+    if (pattern_type == 'c') {
+        cout << "\n🔍 MINING TOP-" << k << " CONTIGUOUS PATTERNS:" << endl;
+        patterns = miner.find_top_k_patterns(k, min_support, false);
+        // Filter out non-contiguous patterns
+        patterns.erase(remove_if(patterns.begin(), patterns.end(), 
+                                [](const PatternInfo& p) { return p.is_noncontiguous; }), 
+                      patterns.end());
+    } else if (pattern_type == 'n') {
+        cout << "\n🔍 MINING TOP-" << k << " NON-CONTIGUOUS PATTERNS:" << endl;
+        patterns = miner.find_top_k_patterns(k, min_support, true);
+    } else {
+        cout << "\n🔍 MINING TOP-" << k << " PATTERNS (ALL TYPES):" << endl;
+        patterns = miner.find_top_k_patterns(k, min_support, false);
+    }
+    
+    // Display results
+    if (!patterns.empty()) {
+        cout << "\nFound " << patterns.size() << " patterns:" << endl;
+        cout << string(80, '-') << endl;
+        
+        for (size_t i = 0; i < patterns.size(); ++i) {
+            cout << setw(2) << (i + 1) << ". " << setw(35) << left << patterns[i].pattern_string
+                 << " [" << setw(12) << patterns[i].pattern_type << "] "
+                 << "Freq: " << setw(2) << patterns[i].frequency << " "
+                 << "Support: " << fixed << setprecision(2) << patterns[i].support << endl;
+        }
+        
+        // Print statistics
+        miner.print_statistics();
+        
+    } else {
+        cout << "No patterns found with the given parameters." << endl;
+        cout << "Try reducing min_support or increasing max_length." << endl;
+    }
+}
+
+void demonstrate_subsequence_miner() {
+    cout << "=== Advanced Subsequence Miner Demo ===" << endl;
+    
+    // Initialize miner
+    AdvancedSubsequenceMiner miner(2, 4);
+    
+    // Sample data
+    auto sample_sequences = get_demo_data();
+    
+    // Add sequences
+    for (size_t i = 0; i < sample_sequences.size(); ++i) {
+        miner.add_sequence(sample_sequences[i], static_cast<int>(i));
+    }
+    
+    cout << "\nAdded " << sample_sequences.size() << " user interaction sequences" << endl;
+    cout << "Example sequence: ";
+    for (size_t i = 0; i < sample_sequences[0].size(); ++i) {
+        if (i > 0) cout << " -> ";
+        cout << sample_sequences[0][i];
+    }
+    cout << endl;
+    
+    // Mine patterns
+    cout << "\n🔍 Mining frequent patterns (min_support=2)..." << endl;
+    auto frequent_patterns = miner.mine_frequent_patterns(2);
+    
+    cout << "\nFound " << frequent_patterns.size() << " frequent patterns:" << endl;
+    
+    // Display top patterns
+    for (size_t i = 0; i < min(static_cast<size_t>(10), frequent_patterns.size()); ++i) {
+        cout << setw(2) << (i + 1) << ". " << setw(30) << left << frequent_patterns[i].pattern_string
+             << " [" << setw(12) << frequent_patterns[i].pattern_type << "] "
+             << "(freq: " << frequent_patterns[i].frequency 
+             << ", support: " << fixed << setprecision(2) << frequent_patterns[i].support << ")" << endl;
+    }
+    
+    // Top-k patterns
+    cout << "\n=== Top 5 Most Frequent Patterns ===" << endl;
+    auto top_patterns = miner.find_top_k_patterns(5, 2);
+    
+    for (size_t i = 0; i < top_patterns.size(); ++i) {
+        cout << (i + 1) << ". " << top_patterns[i].pattern_string 
+             << " [" << top_patterns[i].pattern_type << "] - Frequency: " 
+             << top_patterns[i].frequency << endl;
+    }
+    
+    // Non-contiguous patterns
+    cout << "\n=== Top 3 Non-Contiguous Patterns ===" << endl;
+    auto noncontiguous_patterns = miner.find_top_k_patterns(3, 2, true);
+    
+    for (size_t i = 0; i < noncontiguous_patterns.size(); ++i) {
+        cout << (i + 1) << ". " << noncontiguous_patterns[i].pattern_string 
+             << " - Frequency: " << noncontiguous_patterns[i].frequency << endl;
+    }
+    
+    // Exact non-contiguous patterns via pattern growth
+    cout << "\n=== Top 3 Non-Contiguous Patterns (pattern growth, per-sequence support) ===" << endl;
+    AdvancedSubsequenceMiner growth_miner(2, 4);
+    growth_miner.set_engine(MiningEngine::PatternGrowth);
+    for (size_t i = 0; i < sample_sequences.size(); ++i) {
+        growth_miner.add_sequence(sample_sequences[i], static_cast<int>(i));
+    }
+    auto growth_patterns = growth_miner.find_top_k_patterns(3, 2, true);
+    
+    for (size_t i = 0; i < growth_patterns.size(); ++i) {
+        cout << (i + 1) << ". " << growth_patterns[i].pattern_string 
+             << " - Frequency: " << growth_patterns[i].frequency 
+             << ", support: " << fixed << setprecision(2) << growth_patterns[i].support << endl;
+    }
+    
+    // Statistics
+    miner.print_statistics();
+}
+
+// Shape of a synthetic dataset for benchmarks
+enum class LengthDistribution {
+    Uniform,    // uniform over [min_length, max_length]
+    Geometric,  // geometric with the given mean, clamped to the range
+    Poisson     // Poisson with the given mean, clamped to the range
+};
+
+struct WorkloadConfig {
+    size_t sequences = 10000;
+    size_t alphabet_size = 100;
+    double zipf_exponent = 1.0;      // token popularity skew; 0 is uniform
+    double markov_probability = 0.7; // chance the next token follows the transition table
+    size_t successors = 4;           // successors per token in the transition table
+    LengthDistribution length_distribution = LengthDistribution::Poisson;
+    int min_length = 2;
+    int max_length = 30;
+    double mean_length = 8.0;
+    uint32_t seed = 42;
+};
+
+// Generates sequences from a Zipfian unigram model mixed with a sparse
+// Markov chain: each token has a few preferred successors (themselves drawn
+// by popularity and ranked by a second Zipf law), which gives the recurring
+// paths real event logs have. The same config always yields the same data.
+class SyntheticWorkloadGenerator {
+private:
+    WorkloadConfig config;
+    mt19937 rng;
+    vector<double> popularity_cdf;
+    vector<double> successor_cdf;
+    vector<vector<uint32_t>> transitions;
+    
+    static vector<double> zipf_cdf(size_t n, double exponent) {
+        vector<double> cdf(n);
+        double total = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            total += 1.0 / pow(static_cast<double>(i + 1), exponent);
+            cdf[i] = total;
+        }
+        for (double& c : cdf) c /= total;
+        return cdf;
+    }
+    
+    size_t sample(const vector<double>& cdf) {
+        double u = uniform_real_distribution<double>(0.0, 1.0)(rng);
+        return min(static_cast<size_t>(lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin()), 
+                   cdf.size() - 1);
+    }
+    
+    int sample_length() {
+        int length;
+        switch (config.length_distribution) {
+            case LengthDistribution::Uniform:
+                length = uniform_int_distribution<int>(config.min_length, config.max_length)(rng);
+                break;
+            case LengthDistribution::Geometric:
+                length = config.min_length + geometric_distribution<int>(
+                    1.0 / max(1.0, config.mean_length - config.min_length + 1.0))(rng);
+                break;
+            default:
+                length = poisson_distribution<int>(config.mean_length)(rng);
+                break;
+        }
+        return max(config.min_length, min(config.max_length, length));
+    }
+    
+public:
+    explicit SyntheticWorkloadGenerator(const WorkloadConfig& cfg) : config(cfg), rng(cfg.seed) {
+        config.alphabet_size = max<size_t>(config.alphabet_size, 1);
+        config.successors = max<size_t>(config.successors, 1);
+        config.min_length = max(config.min_length, 1);
+        config.max_length = max(config.max_length, config.min_length);
+        
+        popularity_cdf = zipf_cdf(config.alphabet_size, config.zipf_exponent);
+        successor_cdf = zipf_cdf(config.successors, 1.0);
+        transitions.resize(config.alphabet_size);
+        for (auto& next : transitions) {
+            for (size_t i = 0; i < config.successors; ++i) {
+                next.push_back(static_cast<uint32_t>(sample(popularity_cdf)));
+            }
+        }
+    }
+    
+    vector<vector<string>> generate() {
+        vector<string> names(config.alphabet_size);
+        for (size_t i = 0; i < names.size(); ++i) names[i] = "e" + to_string(i);
+        
+        bernoulli_distribution follow(config.markov_probability);
+        vector<vector<string>> sequences(config.sequences);
+        for (auto& sequence : sequences) {
+            int length = sample_length();
+            sequence.reserve(length);
+            size_t token = sample(popularity_cdf);
+            for (int i = 0; i < length; ++i) {
+                sequence.push_back(names[token]);
+                token = follow(rng) ? transitions[token][sample(successor_cdf)] : sample(popularity_cdf);
+            }
+        }
+        return sequences;
+    }
+};
+
+void parallel_scaling_report() {
+    cout << "=== Parallel Index Build Scaling ===" << endl;
+    
+    // Random walks over the demo vocabulary, sized so each build takes a while
+    vector<string> vocabulary;
+    for (const auto& sequence : get_demo_data()) {
+        for (const auto& token : sequence) {
+            if (find(vocabulary.begin(), vocabulary.end(), token) == vocabulary.end()) {
+                vocabulary.push_back(token);
+            }
+        }
+    }
+    
+    mt19937 rng(42);
+    uniform_int_distribution<size_t> pick(0, vocabulary.size() - 1);
+    uniform_int_distribution<int> length(4, 30);
+    vector<vector<string>> sequences(20000);
+    for (auto& sequence : sequences) {
+        sequence.resize(length(rng));
+        for (auto& token : sequence) token = vocabulary[pick(rng)];
+    }
+    
+    int max_threads = max(1, static_cast<int>(thread::hardware_concurrency()));
+    vector<PatternInfo> serial_patterns;
+    double serial_ms = 0.0;
+    
+    cout << "Sequences: " << sequences.size() << ", hardware threads: " << max_threads << endl;
+    cout << setw(8) << "threads" << setw(14) << "build (ms)" << setw(10) << "speedup" 
+         << setw(12) << "identical" << endl;
+    
+    vector<int> thread_counts;
+    for (int threads = 1; threads < max_threads; threads *= 2) thread_counts.push_back(threads);
+    thread_counts.push_back(max_threads);
+    
+    for (int threads : thread_counts) {
+        AdvancedSubsequenceMiner miner(2, 6, threads);
+        
+        auto start_time = high_resolution_clock::now();
+        miner.add_sequences(sequences);
+        auto end_time = high_resolution_clock::now();
+        double build_ms = duration_cast<microseconds>(end_time - start_time).count() / 1000.0;
+        
+        auto patterns = miner.mine_frequent_patterns(2);
+        bool identical = true;
+        if (threads == 1) {
+            serial_patterns = patterns;
+            serial_ms = build_ms;
+        } else {
+            identical = patterns.size() == serial_patterns.size();
+            for (size_t i = 0; identical && i < patterns.size(); ++i) {
+                identical = patterns[i].pattern_string == serial_patterns[i].pattern_string && 
+                            patterns[i].frequency == serial_patterns[i].frequency && 
+                            patterns[i].is_noncontiguous == serial_patterns[i].is_noncontiguous;
+            }
+        }
+        
+        cout << setw(8) << threads << setw(14) << fixed << setprecision(1) << build_ms 
+             << setw(9) << setprecision(2) << (build_ms > 0.0 ? serial_ms / build_ms : 0.0) << "x" 
+             << setw(12) << (identical ? "yes" : "NO") << endl;
+    }
+}
+
+// Largest resident set so far, in KiB
+long peak_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Nearest-rank percentile of sorted samples
+double percentile(const vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t rank = static_cast<size_t>(ceil(p / 100.0 * sorted.size()));
+    return sorted[min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+vector<int> parse_int_list(const string& value) {
+    vector<int> values;
+    for (const string& item : split_string(value, ',')) values.push_back(stoi(item));
+    if (values.empty()) throw invalid_argument(value);
+    return values;
+}
+
+// Times fn repeats times and writes one JSON line with latency percentiles
+template <typename Fn>
+void benchmark_operation(ostream& out, const string& operation, const string& context, 
+                         int repeats, size_t sequences, Fn fn) {
+    vector<double> samples;
+    size_t patterns = 0;
+    for (int r = 0; r < repeats; ++r) {
+        auto start_time = high_resolution_clock::now();
+        patterns = fn();
+        auto end_time = high_resolution_clock::now();
+        samples.push_back(duration_cast<nanoseconds>(end_time - start_time).count() / 1e6);
+    }
+    sort(samples.begin(), samples.end());
+    
+    double mean = 0.0;
+    for (double sample : samples) mean += sample;
+    mean /= max<size_t>(samples.size(), 1);
+    
+    out << fixed << setprecision(4) << "{\"operation\":\"" << operation << "\"," << context 
+        << ",\"repeats\":" << repeats << ",\"patterns\":" << patterns 
+        << ",\"mean_ms\":" << mean << ",\"p50_ms\":" << percentile(samples, 50) 
+        << ",\"p90_ms\":" << percentile(samples, 90) << ",\"p99_ms\":" << percentile(samples, 99) 
+        << ",\"max_ms\":" << samples.back() 
+        << ",\"sequences_per_s\":" << (mean > 0.0 ? sequences / (mean / 1000.0) : 0.0) 
+        << ",\"peak_rss_kb\":" << peak_rss_kb() << "}" << endl;
+}
+
+void print_benchmark_usage(const char* program) {
+    cout << "Usage: " << program << " --benchmark [options]" << endl;
+    cout << "  --sizes N,N,...         dataset sizes in sequences (default 1000,4000,16000)" << endl;
+    cout << "  --max-lengths N,...     max_length values (default 3,4)" << endl;
+    cout << "  --min-supports N,...    min_support values (default 2,10,50)" << endl;
+    cout << "  --top-k N               k for find_top_k_patterns (default 10)" << endl;
+    cout << "  --repeats N             runs per measurement (default 5)" << endl;
+    cout << "  --alphabet N            distinct tokens (default 100)" << endl;
+    cout << "  --zipf S                token popularity exponent (default 1.0)" << endl;
+    cout << "  --markov P              probability of a Markov transition (default 0.7)" << endl;
+    cout << "  --lengths uniform|geometric|poisson  sequence length distribution (default poisson)" << endl;
+    cout << "  --mean-length N         mean sequence length (default 8)" << endl;
+    cout << "  --engine NAME           trie, growth, automaton, bitmap or ngram (default trie)" << endl;
+    cout << "  --threads N             index build threads (default: hardware)" << endl;
+    cout << "  --seed N                generator seed (default 42)" << endl;
+    cout << "  --output FILE           write JSON lines to FILE instead of stdout" << endl;
+}
+
+// Runs the build, mine_frequent_patterns and find_top_k_patterns over a grid
+// of synthetic datasets and emits one JSON object per measurement
+int run_benchmark(int argc, char* argv[]) {
+    WorkloadConfig workload;
+    vector<int> sizes = {1000, 4000, 16000}, max_lengths = {3, 4}, min_supports = {2, 10, 50};
+    int k = 10, repeats = 5;
+    int threads = max(1, static_cast<int>(thread::hardware_concurrency()));
+    MiningEngine engine = MiningEngine::Trie;
+    string output_path;
+    
+    for (int i = 2; i < argc; ++i) {
+        string flag = argv[i];
+        if (flag == "--help" || flag == "-h") {
+            print_benchmark_usage(argv[0]);
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            cout << "Missing value for " << flag << endl;
+            print_benchmark_usage(argv[0]);
+            return 1;
+        }
+        
+        string value = argv[++i];
+        try {
+            if (flag == "--sizes") sizes = parse_int_list(value);
+            else if (flag == "--max-lengths") max_lengths = parse_int_list(value);
+            else if (flag == "--min-supports") min_supports = parse_int_list(value);
+            else if (flag == "--top-k") k = stoi(value);
+            else if (flag == "--repeats") repeats = max(1, stoi(value));
+            else if (flag == "--alphabet") workload.alphabet_size = stoul(value);
+            else if (flag == "--zipf") workload.zipf_exponent = stod(value);
+            else if (flag == "--markov") workload.markov_probability = stod(value);
+            else if (flag == "--mean-length") workload.mean_length = stod(value);
+            else if (flag == "--threads") threads = stoi(value);
+            else if (flag == "--seed") workload.seed = static_cast<uint32_t>(stoul(value));
+            else if (flag == "--output") output_path = value;
+            else if (flag == "--engine") {
+                if (!parse_engine_name(value, engine)) throw invalid_argument(value);
+            } else if (flag == "--lengths") {
+                if (value == "uniform") workload.length_distribution = LengthDistribution::Uniform;
+                else if (value == "geometric") workload.length_distribution = LengthDistribution::Geometric;
+                else if (value == "poisson") workload.length_distribution = LengthDistribution::Poisson;
+                else throw invalid_argument(value);
+            } else {
+                cout << "Unknown option: " << flag << endl;
+                print_benchmark_usage(argv[0]);
+                return 1;
+            }
+        } catch (...) {
+            cout << "Invalid value for " << flag << ": " << value << endl;
+            return 1;
+        }
+    }
+    
+    ofstream file;
+    if (!output_path.empty()) {
+        file.open(output_path);
+        if (!file) {
+            cout << "Cannot open " << output_path << endl;
+            return 1;
+        }
+    }
+    ostream& out = output_path.empty() ? cout : file;
+    
+    for (int size : sizes) {
+        workload.sequences = static_cast<size_t>(max(size, 0));
+        auto sequences = SyntheticWorkloadGenerator(workload).generate();
+        size_t tokens = 0;
+        for (const auto& sequence : sequences) tokens += sequence.size();
+        
+        for (int max_length : max_lengths) {
+            ostringstream context;
+            context << "\"engine\":\"" << engine_name(engine) << "\",\"sequences\":" << sequences.size() 
+                    << ",\"tokens\":" << tokens << ",\"alphabet\":" << workload.alphabet_size 
+                    << ",\"max_length\":" << max_length << ",\"threads\":" << threads;
+            
+            // Build is measured once per repeat on a fresh miner; the last one is kept
+            unique_ptr<AdvancedSubsequenceMiner> miner;
+            benchmark_operation(out, "build", context.str(), repeats, sequences.size(), [&]() {
+                miner = make_unique<AdvancedSubsequenceMiner>(2, max_length, threads);
+                miner->set_engine(engine);
+                miner->set_result_caching(false);  // every repeat must mine
+                miner->add_sequences(sequences);
+                return size_t(0);
+            });
+            
+            for (int min_support : min_supports) {
+                string grid = context.str() + ",\"min_support\":" + to_string(min_support);
+                benchmark_operation(out, "mine_frequent_patterns", grid, repeats, sequences.size(), [&]() {
+                    return miner->mine_frequent_patterns(min_support).size();
+                });
+                benchmark_operation(out, "find_top_k_patterns", grid + ",\"k\":" + to_string(k), 
+                                    repeats, sequences.size(), [&]() {
+                    return miner->find_top_k_patterns(k, min_support).size();
+                });
+            }
+        }
+    }
+    return 0;
+}
+
+// Escapes a token for a JSON string literal
+string json_escape(string_view text) {
+    string escaped;
+    escaped.reserve(text.size());
+    append_json_escaped(escaped, text);
+    return escaped;
+}
+
+// Line protocol for server mode; every request gets one JSON line back:
+//   LOOKUP a b c            frequency and support of one pattern
+//   BATCH a b | c d | ...   many lookups resolved in one pass over the trie
+//   TOPK k [min_support] [c|n|b]
+//   ADD a b c               index a new sequence, returns its id
+//   STATS | PING | QUIT | SHUTDOWN
+// Lookups hold a shared lock, so concurrent clients read one consistent
+// index and a batch never sees a half-applied ADD. ADD, TOPK and STATS take
+// the lock exclusively (TOPK updates the result cache and statistics).
+class QueryServer {
+private:
+    AdvancedSubsequenceMiner& miner;
+    shared_mutex index_lock;
+    atomic<bool> stopping;
+    
+    static string pattern_json(const PatternInfo& info) {
+        ostringstream json;
+        json << "{\"pattern\":[";
+        for (size_t i = 0; i < info.pattern.size(); ++i) {
+            if (i > 0) json << ",";
+            json << "\"" << json_escape(info.pattern[i]) << "\"";
+        }
+        json << "],\"frequency\":" << info.frequency << ",\"support\":" << fixed << setprecision(6) 
+             << info.support << ",\"noncontiguous\":" << (info.is_noncontiguous ? "true" : "false") << "}";
+        return json.str();
+    }
+    
+    static string error_json(const string& message) {
+        return "{\"error\":\"" + json_escape(message) + "\"}";
+    }
+    
+public:
+    explicit QueryServer(AdvancedSubsequenceMiner& m) : miner(m), stopping(false) {}
+    
+    bool is_stopping() const { return stopping; }
+    
+    // Returns the response line; sets close_session for QUIT and SHUTDOWN
+    string handle(const string& line, bool& close_session) {
+        close_session = false;
+        size_t split = line.find(' ');
+        string command = line.substr(0, split);
+        string arguments = split == string::npos ? "" : line.substr(split + 1);
+        
+        if (command == "LOOKUP") {
+            vector<string> pattern = split_string(arguments);
+            if (pattern.empty()) return error_json("LOOKUP needs a pattern");
+            shared_lock<shared_mutex> read(index_lock);
+            return pattern_json(miner.search_pattern(pattern));
+        }
+        if (command == "BATCH") {
+            vector<vector<string>> patterns;
+            for (const string& part : split_string(arguments, '|')) {
+                vector<string> pattern = split_string(part);
+                if (!pattern.empty()) patterns.push_back(move(pattern));
+            }
+            vector<PatternInfo> results;
+            {
+                shared_lock<shared_mutex> read(index_lock);
+                results = miner.search_patterns(patterns);
+            }
+            string json = "{\"results\":[";
+            for (size_t i = 0; i < results.size(); ++i) {
+                if (i > 0) json += ",";
+                json += pattern_json(results[i]);
+            }
+            return json + "]}";
+        }
+        if (command == "TOPK") {
+            istringstream in(arguments);
+            int k = 10, min_support = 2;
+            char type = 'b';
+            in >> k;
+            if (in) in >> min_support;
+            if (in) in >> type;
+            
+            vector<PatternInfo> patterns;
+            {
+                unique_lock<shared_mutex> write(index_lock);
+                patterns = miner.find_top_k_patterns(k, min_support, type == 'n');
+            }
+            string json = "{\"patterns\":[";
+            bool first = true;
+            for (const PatternInfo& p : patterns) {
+                if (type == 'c' && p.is_noncontiguous) continue;
+                if (!first) json += ",";
+                json += pattern_json(p);
+                first = false;
+            }
+            return json + "]}";
+        }
+        if (command == "ADD") {
+            vector<string> sequence = split_string(arguments);
+            if (sequence.empty()) return error_json("ADD needs a sequence");
+            unique_lock<shared_mutex> write(index_lock);
+            return "{\"id\":" + to_string(miner.add_sequence(sequence)) + "}";
+        }
+        if (command == "STATS") {
+            unique_lock<shared_mutex> write(index_lock);
+            return miner.get_mining_statistics().to_json();
+        }
+        if (command == "PING") return "{\"ok\":true}";
+        if (command == "QUIT" || command == "SHUTDOWN") {
+            close_session = true;
+            if (command == "SHUTDOWN") stopping = true;
+            return "{\"ok\":true}";
+        }
+        return error_json("unknown command " + command);
+    }
+};
+
+// Connected clients of serve_unix_socket. Sessions are joined rather than
+// detached, so none is still inside the miner when the server returns.
+// A session's fd is closed under the lock, so stop_all never shuts down
+// an fd that has already been closed and reused.
+class ClientSessions {
+private:
+    struct Session {
+        thread worker;
+        int client;
+        bool finished;
+    };
+    mutex lock;
+    list<Session> sessions;
+    
+public:
+    // Registers the client before its thread starts, so stop_all always sees it
+    Session* open(int client) {
+        lock_guard<mutex> guard(lock);
+        sessions.push_back({thread(), client, false});
+        return &sessions.back();
+    }
+    
+    void start(Session* session, thread worker) {
+        lock_guard<mutex> guard(lock);
+        session->worker = move(worker);
+    }
+    
+    void finish(Session* session) {
+        lock_guard<mutex> guard(lock);
+        close(session->client);
+        session->finished = true;
+    }
+    
+    // Joins the sessions whose clients have gone
+    void reap() {
+        list<Session> done;
+        {
+            lock_guard<mutex> guard(lock);
+            for (auto it = sessions.begin(); it != sessions.end();) {
+                auto next = std::next(it);
+                if (it->finished && it->worker.joinable()) done.splice(done.end(), sessions, it);
+                it = next;
+            }
+        }
+        for (Session& session : done) session.worker.join();
+    }
+    
+    // Disconnects every open client and waits for its session to end
+    void stop_all() {
+        {
+            lock_guard<mutex> guard(lock);
+            for (Session& session : sessions) {
+                if (!session.finished) shutdown(session.client, SHUT_RDWR);
+            }
+        }
+        list<Session> all;
+        {
+            lock_guard<mutex> guard(lock);
+            all.swap(sessions);
+        }
+        for (Session& session : all) {
+            if (session.worker.joinable()) session.worker.join();
+        }
+    }
+};
+
+// Serves one connected client until it disconnects or quits
+void serve_socket_client(QueryServer& server, int client, int listener) {
+    string pending;
+    char buffer[65536];
+    bool close_session = false;
+    bool requested_shutdown = false;
+    
+    while (!close_session) {
+        ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+        if (received <= 0) break;
+        pending.append(buffer, static_cast<size_t>(received));
+        
+        // Answer every complete line in one write
+        string responses;
+        size_t start = 0, newline;
+        while (!close_session && (newline = pending.find('\n', start)) != string::npos) {
+            string line = pending.substr(start, newline - start);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            start = newline + 1;
+            if (line.empty()) continue;
+            responses += server.handle(line, close_session) + "\n";
+            if (line == "SHUTDOWN") requested_shutdown = true;
+        }
+        pending.erase(0, start);
+        
+        for (size_t sent = 0; sent < responses.size();) {
+            ssize_t n = send(client, responses.data() + sent, responses.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                close_session = true;
+                break;
             }
-            cout << endl;
+            sent += static_cast<size_t>(n);
         }
     }
     
-    if (sequences.empty()) {
-        cout << "No sequences provided. Using demo data." << endl;
-        return get_demo_data();
+    // Wake the accept loop so it notices the shutdown. The listener stays open
+    // until every session has been joined, so this never reaches a reused fd.
+    if (requested_shutdown) shutdown(listener, SHUT_RDWR);
+}
+
+int serve_unix_socket(QueryServer& server, const string& socket_path) {
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        cout << "Cannot create socket: " << strerror(errno) << endl;
+        return 1;
     }
     
-    return sequences;
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        cout << "Socket path too long: " << socket_path << endl;
+        close(listener);
+        return 1;
+    }
+    strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+    unlink(socket_path.c_str());
+    
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || 
+        listen(listener, 64) != 0) {
+        cout << "Cannot listen on " << socket_path << ": " << strerror(errno) << endl;
+        close(listener);
+        return 1;
+    }
+    cout << "Listening on " << socket_path << endl;
+    
+    ClientSessions sessions;
+    while (!server.is_stopping()) {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        sessions.reap();
+        auto* session = sessions.open(client);
+        sessions.start(session, thread([&server, &sessions, session, client, listener]() {
+            serve_socket_client(server, client, listener);
+            sessions.finish(session);
+        }));
+    }
+    
+    // Only this loop closes the listener, after the last session has ended
+    sessions.stop_all();
+    close(listener);
+    unlink(socket_path.c_str());
+    return 0;
 }
 
-void interactive_mining() {
-    // Get sequences from user
-    auto sequences = get_user_input();
-    
-    // Get mining parameters
-    int k = 5, min_support = 2, max_length = 4;
-    char pattern_type = 'b';
+void print_server_usage(const char* program) {
+    cout << "Usage: " << program << " --serve (--input FILE | --snapshot FILE) [options]" << endl;
+    cout << "  --input FILE        build the index from an event log" << endl;
+    cout << "  --snapshot FILE     load a saved index snapshot instead" << endl;
+    cout << "  --socket PATH       serve on a Unix-domain socket (default: stdin/stdout)" << endl;
+    cout << "  --max-length N      maximum pattern length when building (default 4)" << endl;
+    cout << "  --threads N         index build threads (default: hardware)" << endl;
+    cout << "Requests, one per line: LOOKUP a b, BATCH a b | c d, TOPK k [min_support] [c|n|b]," << endl;
+    cout << "ADD a b c, STATS, PING, QUIT, SHUTDOWN" << endl;
+}
+
+// Builds or loads the index once, then answers requests until shut down
+int run_server(int argc, char* argv[]) {
+    string input_path, snapshot_path, socket_path;
+    int max_length = 4;
+    int threads = max(1, static_cast<int>(thread::hardware_concurrency()));
     
-    cout << "\nEnter k for top-k patterns (default 5): ";
-    string input;
-    getline(cin, input);
-    if (!input.empty()) {
+    for (int i = 2; i < argc; ++i) {
+        string flag = argv[i];
+        if (flag == "--help" || flag == "-h") {
+            print_server_usage(argv[0]);
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            cout << "Missing value for " << flag << endl;
+            print_server_usage(argv[0]);
+            return 1;
+        }
+        
+        string value = argv[++i];
         try {
-            k = stoi(input);
+            if (flag == "--input") input_path = value;
+            else if (flag == "--snapshot") snapshot_path = value;
+            else if (flag == "--socket") socket_path = value;
+            else if (flag == "--max-length") max_length = stoi(value);
+            else if (flag == "--threads") threads = stoi(value);
+            else {
+                cout << "Unknown option: " << flag << endl;
+                print_server_usage(argv[0]);
+                return 1;
+            }
         } catch (...) {
-            cout << "Invalid input. Using default k=5." << endl;
+            cout << "Invalid value for " << flag << ": " << value << endl;
+            return 1;
         }
     }
     
-    cout << "Enter minimum support (default 2): ";
-    getline(cin, input);
-    if (!input.empty()) {
-        try {
-            min_support = stoi(input);
-        } catch (...) {
-            cout << "Invalid input. Using default min_support=2." << endl;
+    // Status goes to stderr in stdin/stdout mode so the protocol stream stays clean
+    ostream& log = socket_path.empty() ? cerr : cout;
+    AdvancedSubsequenceMiner miner(2, max_length, threads);
+    auto start_time = high_resolution_clock::now();
+    
+    if (!snapshot_path.empty()) {
+        string error;
+        if (!miner.load_snapshot(snapshot_path, &error)) {
+            log << "Cannot load snapshot: " << error << endl;
+            return 1;
+        }
+    } else if (!input_path.empty()) {
+        IngestStatistics ingest = miner.ingest_file(input_path);
+        if (!ingest.success) {
+            log << "Ingestion failed: " << ingest.error << endl;
+            return 1;
         }
     }
+    log << "Index ready: " << miner.get_mining_statistics().total_sequences << " sequences in " 
+        << fixed << setprecision(1) << elapsed_ms(start_time) << " ms" << endl;
     
-    cout << "Enter maximum pattern length (default 4): ";
-    getline(cin, input);
-    if (!input.empty()) {
-        try {
-            max_length = stoi(input);
-        } catch (...) {
-            cout << "Invalid input. Using default max_length=4." << endl;
+    QueryServer server(miner);
+    if (!socket_path.empty()) {
+        return serve_unix_socket(server, socket_path);
+    }
+    
+    string line;
+    bool close_session = false;
+    while (!close_session && getline(cin, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+        cout << server.handle(line, close_session) << "\n" << flush;
+    }
+    return 0;
+}
+
+void print_batch_usage(const char* program) {
+    cout << "Usage: " << program << " --input FILE [options]" << endl;
+    cout << "  --input FILE        newline-delimited sequences, tokens separated by spaces/tabs" << endl;
+    cout << "  --top-k N           number of patterns to report (default 10)" << endl;
+    cout << "  --min-support N     minimum frequency (default 2)" << endl;
+    cout << "  --max-length N      maximum pattern length (default 4)" << endl;
+    cout << "  --type c|n|b        contiguous, non-contiguous or both (default b)" << endl;
+    cout << "  --engine NAME       trie, growth, automaton, bitmap or ngram (default trie)" << endl;
+    cout << "  --closure MODE      all, closed or maximal patterns (default all)" << endl;
+    cout << "  --max-gap N         skip at most N events between pattern events (trie engine)" << endl;
+    cout << "  --min-gap N         skip at least N events between pattern events (trie engine)" << endl;
+    cout << "  --max-window N      span at most N events from first to last (trie engine)" << endl;
+    cout << "  --threads N         worker threads for parsing and indexing (default: hardware)" << endl;
+    cout << "  --dedup on|off      store each distinct sequence once with its copy count as weight;" << endl;
+    cout << "                      same results, snapshots then keep no positions (default off)" << endl;
+    cout << "  --sample N          approximate top-k: mine a random sample of N sequences, doubling" << endl;
+    cout << "                      it until --target-error or --time-budget is reached" << endl;
+    cout << "  --time-budget MS    refinement time budget for --sample (default 1000)" << endl;
+    cout << "  --target-error F    stop once every interval is within F of its estimate (default 0.05)" << endl;
+    cout << "  --stream N          stream the input (- for stdin) over a window of the last N" << endl;
+    cout << "                      sequences, with approximate counts in bounded memory" << endl;
+    cout << "  --stream-counters N counters per window pane in stream mode (default 4096)" << endl;
+    cout << "  --memory-budget MB  mine out of core in partitions, keeping the whole process within" << endl;
+    cout << "                      MB (trie engine)" << endl;
+    cout << "  --temp-dir DIR      where --memory-budget spills candidates (default /tmp)" << endl;
+    cout << "  --workers N         fork N worker processes, one index per input shard, and merge" << endl;
+    cout << "                      their partial counts (trie engine)" << endl;
+    cout << "  --shard I/N         run as worker I of N: index that shard and write its partial" << endl;
+    cout << "                      counts to --partial-output FILE (- for stdout)" << endl;
+    cout << "  --merge-partials F1,F2,...  merge the partial-count files of every shard" << endl;
+    cout << "  --output FILE       export every frequent pattern instead of the top-k (- for stdout)" << endl;
+    cout << "  --format csv|jsonl  --output format (default csv)" << endl;
+    cout << "  --stats-json FILE   write per-phase mining statistics as JSON (- for stdout)" << endl;
+    cout << "  --save-snapshot FILE  after indexing, save the trie index (trie engine only)" << endl;
+    cout << "  --snapshot FILE     query a saved snapshot in place instead of reading --input" << endl;
+    cout << "  --find \"A B ...\"    with --snapshot, look up one pattern and its positions" << endl;
+}
+
+// Queries a memory-mapped snapshot without loading it
+int run_snapshot_query(const string& snapshot_path, const string& find_pattern, 
+                       int k, int min_support, char pattern_type) {
+    auto start_time = high_resolution_clock::now();
+    IndexSnapshot snapshot(snapshot_path);
+    double open_ms = elapsed_ms(start_time);
+    if (!snapshot.is_open()) {
+        cout << "Cannot open snapshot: " << snapshot.get_error() << endl;
+        return 1;
+    }
+    
+    const SnapshotHeader& header = snapshot.get_header();
+    cout << "=== Snapshot ===" << endl;
+    cout << "File: " << snapshot_path << " (" << fixed << setprecision(2) 
+         << header.file_bytes / 1048576.0 << " MB, format v" << header.format_version << ")" << endl;
+    cout << "Sequences: " << header.sequence_count << ", trie nodes: " << header.node_count 
+         << ", symbols: " << header.symbol_count << endl;
+    cout << "Opened in " << setprecision(3) << open_ms << " ms" << endl;
+    
+    if (!find_pattern.empty()) {
+        vector<string> pattern = split_string(find_pattern);
+        PatternInfo info = snapshot.search_pattern(pattern);
+        vector<Position> positions = snapshot.get_positions(pattern);
+        cout << "\nPattern: " << find_pattern << endl;
+        cout << "Frequency: " << info.frequency << ", positions recorded: " << positions.size() << endl;
+        for (size_t i = 0; i < min<size_t>(positions.size(), 10); ++i) {
+            cout << "  sequence " << positions[i].sequence_id << " @ " << positions[i].position << endl;
         }
+        return 0;
     }
     
-    cout << "Pattern type - (c)ontiguous, (n)on-contiguous, or (b)oth? (default: both): ";
-    getline(cin, input);
-    if (!input.empty()) {
-        pattern_type = static_cast<char>(tolower(input[0]));
-        if (pattern_type != 'c' && pattern_type != 'n' && pattern_type != 'b') {
-            pattern_type = 'b';
+    start_time = high_resolution_clock::now();
+    vector<PatternInfo> patterns = snapshot.get_top_k_patterns(static_cast<size_t>(max(k, 0)), 
+                                                               min_support, pattern_type == 'n');
+    double query_ms = elapsed_ms(start_time);
+    if (pattern_type == 'c') {
+        patterns.erase(remove_if(patterns.begin(), patterns.end(), 
+                                [](const PatternInfo& p) { return p.is_noncontiguous; }), 
+                      patterns.end());
+    }
+    
+    cout << "\n=== Top-" << k << " Patterns (" << setprecision(3) << query_ms << " ms) ===" << endl;
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        cout << setw(2) << (i + 1) << ". " << setw(35) << left << patterns[i].pattern_string
+             << " [" << setw(12) << patterns[i].pattern_type << "] " << right
+             << "Freq: " << patterns[i].frequency << " "
+             << "Support: " << fixed << setprecision(2) << patterns[i].support << endl;
+    }
+    return 0;
+}
+
+// Streams newline-delimited sequences through a sliding-window miner and
+// reports the final window's top-k with their error bounds
+int run_stream_mining(const string& input_path, size_t window, size_t counters, 
+                      int k, int min_support, int max_length, char pattern_type, 
+                      const GapConstraints& gap_constraints) {
+    ifstream file;
+    if (input_path != "-") {
+        file.open(input_path);
+        if (!file) {
+            cout << "Cannot open " << input_path << endl;
+            return 1;
         }
     }
+    istream& in = input_path == "-" ? cin : file;
     
-    // Initialize miner
-    AdvancedSubsequenceMiner miner(2, max_length);
+    StreamingSubsequenceMiner miner(2, max_length, StreamWindow::Count, static_cast<double>(window), counters);
+    miner.set_gap_constraints(gap_constraints);
+    auto start_time = high_resolution_clock::now();
     
-    // Add sequences
-    for (size_t i = 0; i < sequences.size(); ++i) {
-        miner.add_sequence(sequences[i], static_cast<int>(i));
+    string line;
+    while (getline(in, line)) {
+        for (char& c : line) {
+            if (c == '\t' || c == '\r') c = ' ';
+        }
+        vector<string> sequence = split_string(line);
+        if (!sequence.empty()) miner.add_sequence(sequence);
     }
     
-    cout << "\n" << string(60, '=') << endl;
-    cout << "MINING RESULTS" << endl;
-    cout << string(60, '=') << endl;
-    cout << "Dataset: " << sequences.size() << " sequences" << endl;
-    cout << "Parameters: k=" << k << ", min_support=" << min_support 
-         << ", max_length=" << max_length << endl;
+    double elapsed = duration_cast<microseconds>(high_resolution_clock::now() - start_time).count() / 1000.0;
     
-    // Mine patterns based on user preference
-    vector<PatternInfo> patterns;
+    cout << "=== Stream ===" << endl;
+    cout << "Sequences seen: " << miner.get_sequences_seen() << ", in window: " 
+         << fixed << setprecision(0) << miner.window_sequences() << endl;
+    cout << "Counters: " << miner.counter_count() << ", error bound: " 
+         << setprecision(2) << miner.error_bound() << endl;
+    cout << "Time: " << elapsed << " ms" << endl;
     
+    auto patterns = miner.get_top_k(static_cast<size_t>(max(k, 0)) * (pattern_type == 'c' ? 4 : 1), 
+                                    min_support, pattern_type == 'n');
     if (pattern_type == 'c') {
-        cout << "\n🔍 MINING TOP-" << k << " CONTIGUOUS PATTERNS:" << endl;
-        patterns = miner.find_top_k_patterns(k, min_support, false);
-        // Filter out non-contiguous patterns
         patterns.erase(remove_if(patterns.begin(), patterns.end(), 
-                                [](const PatternInfo& p) { return p.is_noncontiguous; }), 
+                                [](const StreamPatternEstimate& p) { return p.is_noncontiguous; }), 
                       patterns.end());
-    } else if (pattern_type == 'n') {
-        cout << "\n🔍 MINING TOP-" << k << " NON-CONTIGUOUS PATTERNS:" << endl;
-        patterns = miner.find_top_k_patterns(k, min_support, true);
-    } else {
-        cout << "\n🔍 MINING TOP-" << k << " PATTERNS (ALL TYPES):" << endl;
-        patterns = miner.find_top_k_patterns(k, min_support, false);
+    }
+    if (patterns.size() > static_cast<size_t>(max(k, 0))) {
+        patterns.erase(patterns.begin() + max(k, 0), patterns.end());
     }
     
-    // Display results
-    if (!patterns.empty()) {
-        cout << "\nFound " << patterns.size() << " patterns:" << endl;
-        cout << string(80, '-') << endl;
-        
-        for (size_t i = 0; i < patterns.size(); ++i) {
-            cout << setw(2) << (i + 1) << ". " << setw(35) << left << patterns[i].pattern_string
-                 << " [" << setw(12) << patterns[i].pattern_type << "] "
-                 << "Freq: " << setw(2) << patterns[i].frequency << " "
-                 << "Support: " << fixed << setprecision(2) << patterns[i].support << endl;
+    cout << "\n=== Top-" << k << " Patterns (window estimate) ===" << endl;
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        cout << setw(2) << (i + 1) << ". " << setw(35) << left << patterns[i].pattern_string << right
+             << " Freq: " << setprecision(0) << patterns[i].frequency 
+             << " (+0/-" << patterns[i].error << ")" << endl;
+    }
+    return 0;
+}
+
+// Prints the top-k of the patterns export_patterns(sink) streams, or exports
+// them all to output_path; shared by the modes whose results arrive as
+// PatternViews instead of from one in-memory miner. export_patterns returns
+// false if the stream failed, in which case nothing is printed.
+template <typename Export>
+int report_pattern_stream(Export export_patterns, const SymbolTable& symbols, size_t sequences, 
+                          int k, int min_support, char pattern_type, 
+                          const string& output_path, ResultFormat output_format, ostream& report) {
+    if (!output_path.empty()) {
+        PatternWriter writer(output_path, output_format, sequences);
+        if (!writer.is_open()) {
+            cout << "Cannot export: " << writer.get_error() << endl;
+            return 1;
         }
-        
-        // Print statistics
-        miner.print_statistics();
-        
-    } else {
-        cout << "No patterns found with the given parameters." << endl;
-        cout << "Try reducing min_support or increasing max_length." << endl;
+        auto sink = [&](const PatternView& pattern) {
+            if (pattern_type != 'c' || !pattern.is_noncontiguous) writer(pattern);
+        };
+        if (!export_patterns(sink)) return 1;
+        if (!writer.flush()) {
+            report << "Cannot export: " << writer.get_error() << endl;
+            return 1;
+        }
+        report << "Exported " << writer.row_count() << " patterns to " << output_path << endl;
+        return 0;
+    }
+    
+    TopKCollector top_k(static_cast<size_t>(max(k, 0)), min_support);
+    auto sink = [&](const PatternView& pattern) {
+        if (pattern_type != 'c' || !pattern.is_noncontiguous) {
+            top_k.offer(pattern.tokens, pattern.length, pattern.frequency, pattern.is_noncontiguous);
+        }
+    };
+    if (!export_patterns(sink)) return 1;
+    
+    vector<PatternCount> patterns = top_k.take_sorted();
+    cout << "\n=== Top-" << k << " Patterns ===" << endl;
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        string pattern_string;
+        for (TokenId token : get<0>(patterns[i])) {
+            if (!pattern_string.empty()) pattern_string += " -> ";
+            pattern_string += symbols.decode(token);
+        }
+        cout << setw(2) << (i + 1) << ". " << setw(35) << left << pattern_string
+             << " [" << setw(12) << (get<2>(patterns[i]) ? "Non-contiguous" : "Contiguous") << "] " << right
+             << "Freq: " << get<1>(patterns[i]) << " "
+             << "Support: " << fixed << setprecision(2) 
+             << static_cast<double>(get<1>(patterns[i])) / max<size_t>(sequences, 1) << endl;
     }
+    return 0;
 }
 
-void demonstrate_subsequence_miner() {
-    cout << "=== Advanced Subsequence Miner Demo ===" << endl;
+// Mines a file larger than memory in budget-sized partitions and reports the
+// exact top-k, or exports every frequent pattern with --output
+int run_partitioned_mining(const string& input_path, size_t budget_mb, const string& temp_dir, 
+                           int k, int min_support, int max_length, char pattern_type, int threads, 
+                           const GapConstraints& gap_constraints, 
+                           const string& output_path, ResultFormat output_format) {
+    if (input_path == "-") {
+        cout << "--memory-budget reads the input twice and cannot take stdin" << endl;
+        return 1;
+    }
     
-    // Initialize miner
-    AdvancedSubsequenceMiner miner(2, 4);
+    PartitionedMiner miner(2, max_length, budget_mb * 1048576, threads, temp_dir);
+    miner.set_gap_constraints(gap_constraints);
+    PartitionedMiningStatistics result = miner.mine(input_path, min_support);
+    if (!result.success) {
+        cout << "Partitioned mining failed: " << result.error << endl;
+        return 1;
+    }
     
-    // Sample data
-    auto sample_sequences = get_demo_data();
+    ostream& report = output_path == "-" ? cerr : cout;
+    report << "=== Partitioned Mining ===" << endl;
+    report << "Input: " << input_path << ", budget: " << budget_mb << " MB" << endl;
+    report << "Sequences: " << result.sequences << ", partitions: " << result.partitions 
+           << ", largest partition: " << fixed << setprecision(2) 
+           << result.peak_partition_bytes / 1048576.0 << " MB" << endl;
+    report << "Candidates: " << result.candidates << endl;
+    report << "Pass 1: " << setprecision(1) << result.partition_time << " ms, merge: " 
+           << result.merge_time << " ms, pass 2: " << result.count_time << " ms" << endl;
     
-    // Add sequences
-    for (size_t i = 0; i < sample_sequences.size(); ++i) {
-        miner.add_sequence(sample_sequences[i], static_cast<int>(i));
+    auto export_patterns = [&](auto& sink) {
+        miner.export_frequent_patterns(sink, pattern_type == 'n');
+        return true;
+    };
+    int status = report_pattern_stream(export_patterns, miner.get_symbols(), result.sequences, k, min_support, 
+                                       pattern_type, output_path, output_format, report);
+    report << "Peak RSS: " << peak_rss_kb() / 1024 << " MB" << endl;
+    return status;
+}
+
+// Worker side of sharded mining: indexes one shard of the input and writes
+// its partial counts to fd
+int run_shard_worker(const string& input_path, size_t shard, size_t shard_count, int max_length, 
+                     int threads, const GapConstraints& gap_constraints, int fd) {
+    AdvancedSubsequenceMiner miner(2, max_length, threads);
+    miner.set_position_tracking(false);
+    miner.set_result_caching(false);
+    miner.set_gap_constraints(gap_constraints);
+    IngestStatistics ingest = miner.ingest_file(input_path, shard, shard_count);
+    if (!ingest.success) {
+        cerr << "Shard " << shard << ": ingestion failed: " << ingest.error << endl;
+        return 1;
     }
     
-    cout << "\nAdded " << sample_sequences.size() << " user interaction sequences" << endl;
-    cout << "Example sequence: ";
-    for (size_t i = 0; i < sample_sequences[0].size(); ++i) {
-        if (i > 0) cout << " -> ";
-        cout << sample_sequences[0][i];
+    string error;
+    if (!write_partial_counts(miner, fd, shard, shard_count, &error)) {
+        cerr << "Shard " << shard << ": " << error << endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Coordinator side: merges partial-count streams and reports the result
+int report_merged_partials(const vector<int>& fds, int k, int min_support, char pattern_type, 
+                           const string& output_path, ResultFormat output_format, ostream& report) {
+    auto start_time = high_resolution_clock::now();
+    PartialCountMerger merger(fds);
+    if (!merger.is_open()) {
+        cout << "Cannot merge partial counts: " << merger.get_error() << endl;
+        return 1;
     }
-    cout << endl;
     
-    // Mine patterns
-    cout << "\n🔍 Mining frequent patterns (min_support=2)..." << endl;
-    auto frequent_patterns = miner.mine_frequent_patterns(2);
+    auto export_patterns = [&](auto& sink) {
+        merger.merge(sink, min_support, pattern_type == 'n');
+        if (merger.is_open()) return true;
+        cout << "Cannot merge partial counts: " << merger.get_error() << endl;
+        return false;
+    };
+    int status = report_pattern_stream(export_patterns, merger.get_symbols(), merger.get_sequence_count(), 
+                                       k, min_support, pattern_type, output_path, output_format, report);
+    if (status != 0) return status;
+    report << "Sequences: " << merger.get_sequence_count() << ", shards: " << fds.size() 
+           << ", merged in " << fixed << setprecision(1) << elapsed_ms(start_time) << " ms" << endl;
+    return status;
+}
+
+// Forks one worker process per shard, each with its own index, and k-way
+// merges the partial counts they stream back over pipes. Workers share
+// nothing with the coordinator but the input path, so the same protocol works
+// with --shard workers started elsewhere and --merge-partials.
+int run_sharded_mining(const string& input_path, size_t workers, int k, int min_support, int max_length, 
+                       char pattern_type, int threads, const GapConstraints& gap_constraints, 
+                       const string& output_path, ResultFormat output_format) {
+    if (input_path == "-") {
+        cout << "--workers maps the input file and cannot take stdin" << endl;
+        return 1;
+    }
+    cout.flush();
     
-    cout << "\nFound " << frequent_patterns.size() << " frequent patterns:" << endl;
+    int worker_threads = max(1, threads / static_cast<int>(workers));
+    vector<int> fds;
+    vector<pid_t> pids;
+    for (size_t shard = 0; shard < workers; ++shard) {
+        int channel[2];
+        if (pipe(channel) != 0) {
+            cout << "Cannot create a pipe: " << strerror(errno) << endl;
+            return 1;
+        }
+        pid_t pid = fork();
+        if (pid < 0) {
+            cout << "Cannot fork a worker: " << strerror(errno) << endl;
+            return 1;
+        }
+        if (pid == 0) {
+            for (int fd : fds) close(fd);
+            close(channel[0]);
+            int status = run_shard_worker(input_path, shard, workers, max_length, worker_threads, 
+                                          gap_constraints, channel[1]);
+            _exit(status);
+        }
+        close(channel[1]);
+        fds.push_back(channel[0]);
+        pids.push_back(pid);
+    }
     
-    // Display top patterns
-    for (size_t i = 0; i < min(static_cast<size_t>(10), frequent_patterns.size()); ++i) {
-        cout << setw(2) << (i + 1) << ". " << setw(30) << left << frequent_patterns[i].pattern_string
-             << " [" << setw(12) << frequent_patterns[i].pattern_type << "] "
-             << "(freq: " << frequent_patterns[i].frequency 
-             << ", support: " << fixed << setprecision(2) << frequent_patterns[i].support << ")" << endl;
+    ostream& report = output_path == "-" ? cerr : cout;
+    int status = report_merged_partials(fds, k, min_support, pattern_type, output_path, output_format, report);
+    for (int fd : fds) close(fd);
+    for (pid_t pid : pids) {
+        int worker_status = 0;
+        if (waitpid(pid, &worker_status, 0) < 0 || !WIFEXITED(worker_status) || WEXITSTATUS(worker_status) != 0) {
+            status = 1;
+        }
     }
+    return status;
+}
+
+// Non-interactive mode: bulk-ingest a file, then report the top-k patterns
+int run_batch_mining(int argc, char* argv[]) {
+    string input_path;
+    int k = 10, min_support = 2, max_length = 4;
+    int threads = max(1, static_cast<int>(thread::hardware_concurrency()));
+    char pattern_type = 'b';
+    MiningEngine engine = MiningEngine::Trie;
+    PatternClosure closure = PatternClosure::All;
+    GapConstraints gap_constraints;
+    bool deduplicate = false;
+    SamplingOptions sampling;
+    bool sampled = false;
+    size_t stream_window = 0, stream_counters = 4096, memory_budget_mb = 0;
+    size_t workers = 0, shard = 0, shard_count = 0;
+    string temp_dir = "/tmp", partial_output_path, merge_partials;
+    string stats_path, save_snapshot_path, snapshot_path, find_pattern, output_path;
+    ResultFormat output_format = ResultFormat::Csv;
     
-    // Top-k patterns
-    cout << "\n=== Top 5 Most Frequent Patterns ===" << endl;
-    auto top_patterns = miner.find_top_k_patterns(5, 2);
+    for (int i = 1; i < argc; ++i) {
+        string flag = argv[i];
+        if (flag == "--help" || flag == "-h") {
+            print_batch_usage(argv[0]);
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            cout << "Missing value for " << flag << endl;
+            print_batch_usage(argv[0]);
+            return 1;
+        }
+        
+        string value = argv[++i];
+        try {
+            if (flag == "--input") {
+                input_path = value;
+            } else if (flag == "--top-k") {
+                k = stoi(value);
+            } else if (flag == "--min-support") {
+                min_support = stoi(value);
+            } else if (flag == "--max-length") {
+                max_length = stoi(value);
+            } else if (flag == "--threads") {
+                threads = stoi(value);
+            } else if (flag == "--dedup") {
+                if (value != "on" && value != "off") throw invalid_argument(value);
+                deduplicate = value == "on";
+            } else if (flag == "--sample") {
+                sampling.initial_sample = stoul(value);
+                sampled = true;
+            } else if (flag == "--time-budget") {
+                sampling.time_budget_ms = stod(value);
+            } else if (flag == "--target-error") {
+                sampling.target_error = stod(value);
+            } else if (flag == "--stream") {
+                stream_window = stoul(value);
+            } else if (flag == "--stream-counters") {
+                stream_counters = stoul(value);
+            } else if (flag == "--memory-budget") {
+                memory_budget_mb = stoul(value);
+            } else if (flag == "--temp-dir") {
+                temp_dir = value;
+            } else if (flag == "--workers") {
+                workers = stoul(value);
+            } else if (flag == "--shard") {
+                size_t slash = value.find('/');
+                if (slash == string::npos) throw invalid_argument(value);
+                shard = stoul(value.substr(0, slash));
+                shard_count = stoul(value.substr(slash + 1));
+                if (shard >= shard_count) throw invalid_argument(value);
+            } else if (flag == "--partial-output") {
+                partial_output_path = value;
+            } else if (flag == "--merge-partials") {
+                merge_partials = value;
+            } else if (flag == "--output") {
+                output_path = value;
+            } else if (flag == "--format") {
+                if (!parse_result_format(value, output_format)) throw invalid_argument(value);
+            } else if (flag == "--stats-json") {
+                stats_path = value;
+            } else if (flag == "--save-snapshot") {
+                save_snapshot_path = value;
+            } else if (flag == "--snapshot") {
+                snapshot_path = value;
+            } else if (flag == "--find") {
+                find_pattern = value;
+            } else if (flag == "--type") {
+                pattern_type = static_cast<char>(tolower(value[0]));
+            } else if (flag == "--engine") {
+                if (!parse_engine_name(value, engine)) throw invalid_argument(value);
+            } else if (flag == "--max-gap") {
+                gap_constraints.max_gap = stoi(value);
+            } else if (flag == "--min-gap") {
+                gap_constraints.min_gap = stoi(value);
+            } else if (flag == "--max-window") {
+                gap_constraints.max_window = stoi(value);
+            } else if (flag == "--closure") {
+                if (!parse_closure_name(value, closure)) throw invalid_argument(value);
+            } else {
+                cout << "Unknown option: " << flag << endl;
+                print_batch_usage(argv[0]);
+                return 1;
+            }
+        } catch (...) {
+            cout << "Invalid value for " << flag << ": " << value << endl;
+            return 1;
+        }
+    }
     
-    for (size_t i = 0; i < top_patterns.size(); ++i) {
-        cout << (i + 1) << ". " << top_patterns[i].pattern_string 
-             << " [" << top_patterns[i].pattern_type << "] - Frequency: " 
-             << top_patterns[i].frequency << endl;
+    if (closure != PatternClosure::All && (!snapshot_path.empty() || stream_window > 0)) {
+        cout << "--closure is not supported with --snapshot or --stream" << endl;
+        return 1;
+    }
+    if (memory_budget_mb > 0 && (!snapshot_path.empty() || stream_window > 0 || engine != MiningEngine::Trie || 
+                                 closure != PatternClosure::All || !save_snapshot_path.empty() || !stats_path.empty())) {
+        cout << "--memory-budget runs the trie engine on its own; it cannot be combined with "
+             << "--snapshot, --stream, --closure, --save-snapshot or --stats-json" << endl;
+        return 1;
+    }
+    bool sharded = workers > 0 || shard_count > 0 || !merge_partials.empty();
+    if (sharded && (!snapshot_path.empty() || stream_window > 0 || memory_budget_mb > 0 || 
+                    engine != MiningEngine::Trie || closure != PatternClosure::All || 
+                    !save_snapshot_path.empty() || !stats_path.empty())) {
+        cout << "--workers, --shard and --merge-partials run the trie engine on their own; they cannot be "
+             << "combined with --snapshot, --stream, --memory-budget, --closure, --save-snapshot or --stats-json" << endl;
+        return 1;
+    }
+    if (deduplicate && (!snapshot_path.empty() || stream_window > 0 || memory_budget_mb > 0 || sharded)) {
+        cout << "--dedup applies to in-memory mining; it cannot be combined with --snapshot, --stream, "
+             << "--memory-budget, --workers, --shard or --merge-partials" << endl;
+        return 1;
+    }
+    if (sampled && (!snapshot_path.empty() || stream_window > 0 || memory_budget_mb > 0 || sharded || 
+                    closure != PatternClosure::All || !output_path.empty())) {
+        cout << "--sample reports an approximate top-k from memory; it cannot be combined with --snapshot, "
+             << "--stream, --memory-budget, --workers, --shard, --merge-partials, --closure or --output" << endl;
+        return 1;
+    }
+    if (gap_constraints.active() && (!snapshot_path.empty() || engine != MiningEngine::Trie)) {
+        cout << "Gap constraints need the trie engine; a snapshot keeps the ones it was built with" << endl;
+        return 1;
+    }
+    if (!snapshot_path.empty()) {
+        return run_snapshot_query(snapshot_path, find_pattern, k, min_support, pattern_type);
+    }
+    if (!merge_partials.empty()) {
+        vector<int> fds;
+        for (const string& path : split_string(merge_partials, ',')) {
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                cout << "Cannot open " << path << ": " << strerror(errno) << endl;
+                for (int open_fd : fds) close(open_fd);
+                return 1;
+            }
+            fds.push_back(fd);
+        }
+        int status = report_merged_partials(fds, k, min_support, pattern_type, output_path, output_format, 
+                                            output_path == "-" ? cerr : cout);
+        for (int fd : fds) close(fd);
+        return status;
+    }
+    if (input_path.empty()) {
+        print_batch_usage(argv[0]);
+        return 1;
+    }
+    if (shard_count > 0) {
+        if (partial_output_path.empty()) {
+            cout << "--shard needs --partial-output" << endl;
+            return 1;
+        }
+        int fd = partial_output_path == "-" ? STDOUT_FILENO 
+               : open(partial_output_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            cout << "Cannot open " << partial_output_path << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        int status = run_shard_worker(input_path, shard, shard_count, max_length, threads, gap_constraints, fd);
+        if (fd != STDOUT_FILENO) close(fd);
+        return status;
+    }
+    if (workers > 0) {
+        return run_sharded_mining(input_path, workers, k, min_support, max_length, pattern_type, threads, 
+                                  gap_constraints, output_path, output_format);
+    }
+    if (memory_budget_mb > 0) {
+        return run_partitioned_mining(input_path, memory_budget_mb, temp_dir, k, min_support, max_length, 
+                                      pattern_type, threads, gap_constraints, output_path, output_format);
+    }
+    if (stream_window > 0) {
+        return run_stream_mining(input_path, stream_window, stream_counters, 
+                                 k, min_support, max_length, pattern_type, gap_constraints);
     }
     
-    // Non-contiguous patterns
-    cout << "\n=== Top 3 Non-Contiguous Patterns ===" << endl;
-    auto noncontiguous_patterns = miner.find_top_k_patterns(3, 2, true);
+    AdvancedSubsequenceMiner miner(2, max_length, threads);
+    miner.set_engine(engine);
+    miner.set_gap_constraints(gap_constraints);
+    if (deduplicate) {
+        // Batch reports never list positions, and saved snapshots need them off
+        miner.set_position_tracking(false);
+        miner.set_deduplication(true);
+    }
     
-    for (size_t i = 0; i < noncontiguous_patterns.size(); ++i) {
-        cout << (i + 1) << ". " << noncontiguous_patterns[i].pattern_string 
-             << " - Frequency: " << noncontiguous_patterns[i].frequency << endl;
+    IngestStatistics ingest = miner.ingest_file(input_path);
+    if (!ingest.success) {
+        cout << "Ingestion failed: " << ingest.error << endl;
+        return 1;
     }
     
-    // Statistics
-    miner.print_statistics();
+    // Exporting to stdout keeps the report on stderr so the data stays clean
+    ostream& report = output_path == "-" ? cerr : cout;
+    report << "=== Ingestion ===" << endl;
+    report << "Input: " << input_path << " (" << fixed << setprecision(2) 
+           << ingest.bytes / 1048576.0 << " MB)" << endl;
+    report << "Sequences: " << ingest.sequences << ", tokens: " << ingest.tokens << endl;
+    report << "Parse: " << setprecision(2) << ingest.parse_time << " ms (" 
+           << ingest.parse_throughput() << " MB/s)" << endl;
+    report << "Index: " << ingest.index_time << " ms (" 
+           << ingest.total_throughput() << " MB/s end to end)" << endl;
+    
+    if (!save_snapshot_path.empty()) {
+        string error;
+        auto save_start = high_resolution_clock::now();
+        if (!miner.save_snapshot(save_snapshot_path, &error)) {
+            cout << "Snapshot failed: " << error << endl;
+            return 1;
+        }
+        report << "Snapshot: " << save_snapshot_path << " (" << elapsed_ms(save_start) << " ms)" << endl;
+    }
+    
+    if (!output_path.empty()) {
+        size_t sequences = static_cast<size_t>(miner.get_mining_statistics().total_sequences);
+        PatternWriter writer(output_path, output_format, sequences);
+        if (!writer.is_open()) {
+            cout << "Cannot export: " << writer.get_error() << endl;
+            return 1;
+        }
+        auto sink = [&](const PatternView& pattern) {
+            if (pattern_type != 'c' || !pattern.is_noncontiguous) writer(pattern);
+        };
+        auto export_start = high_resolution_clock::now();
+        miner.export_frequent_patterns(sink, min_support, pattern_type == 'n', closure);
+        if (!writer.flush()) {
+            report << "Cannot export: " << writer.get_error() << endl;
+            return 1;
+        }
+        report << "Exported " << writer.row_count() << " patterns to " << output_path << " in " 
+               << fixed << setprecision(1) << elapsed_ms(export_start) << " ms" << endl;
+    } else if (sampled) {
+        SampledMiningResult result = miner.find_top_k_patterns_sampled(k, min_support, pattern_type == 'n', sampling);
+        if (pattern_type == 'c') {
+            result.patterns.erase(remove_if(result.patterns.begin(), result.patterns.end(), 
+                                            [](const SampledPatternEstimate& p) { return p.is_noncontiguous; }), 
+                                  result.patterns.end());
+        }
+        
+        cout << "\n=== Approximate Top-" << k << " Patterns ===" << endl;
+        for (size_t i = 0; i < result.patterns.size(); ++i) {
+            const SampledPatternEstimate& p = result.patterns[i];
+            cout << setw(2) << (i + 1) << ". " << setw(35) << left << p.pattern_string
+                 << " [" << setw(14) << (p.is_noncontiguous ? "Non-contiguous" : "Contiguous") << "] " << right
+                 << "Freq: ~" << fixed << setprecision(0) << p.frequency << " (" << p.lower << " - " << p.upper 
+                 << ") Support: " << setprecision(2) << p.support << endl;
+        }
+        cout << "\nSample: " << result.sample_size << " of " << result.population << " sequences in " 
+             << result.rounds << " rounds (support threshold " << result.sample_min_support << "), " 
+             << fixed << setprecision(1) << result.elapsed_ms << " ms" << endl;
+        if (result.exact) {
+            cout << "The sample reached the database size, so the counts are exact" << endl;
+        } else {
+            cout << "Widest interval: +/-" << setprecision(1) << result.relative_error * 100 << "% at " 
+                 << setprecision(0) << sampling.confidence * 100 << "% confidence (target " 
+                 << (result.target_met ? "met" : "not met") << ")" << endl;
+        }
+    } else {
+        vector<PatternInfo> patterns = miner.find_top_k_patterns(k, min_support, pattern_type == 'n', closure);
+        if (pattern_type == 'c') {
+            patterns.erase(remove_if(patterns.begin(), patterns.end(), 
+                                    [](const PatternInfo& p) { return p.is_noncontiguous; }), 
+                          patterns.end());
+        }
+        
+        cout << "\n=== Top-" << k << " Patterns ===" << endl;
+        for (size_t i = 0; i < patterns.size(); ++i) {
+            cout << setw(2) << (i + 1) << ". " << setw(35) << left << patterns[i].pattern_string
+                 << " [" << setw(12) << patterns[i].pattern_type << "] " << right
+                 << "Freq: " << patterns[i].frequency << " "
+                 << "Support: " << fixed << setprecision(2) << patterns[i].support << endl;
+        }
+        
+        miner.print_statistics();
+    }
+    
+    if (!stats_path.empty()) {
+        string json = miner.get_mining_statistics().to_json();
+        if (stats_path == "-") {
+            report << json << endl;
+        } else {
+            ofstream stats_file(stats_path);
+            if (!stats_file) {
+                cout << "Cannot open " << stats_path << endl;
+                return 1;
+            }
+            stats_file << json << endl;
+        }
+    }
+    return 0;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    if (argc > 1 && string(argv[1]) == "--benchmark") {
+        return run_benchmark(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--serve") {
+        return run_server(argc, argv);
+    }
+    if (argc > 1) {
+        return run_batch_mining(argc, argv);
+    }
+    
     cout << "Choose mode:" << endl;
     cout << "1. Interactive Mining (user input)" << endl;
     cout << "2. Demo with sample data" << endl;
+    cout << "3. Parallel index build scaling report" << endl;
     
     char choice;
-    cout << "Enter choice (1 or 2): ";
+    cout << "Enter choice (1, 2 or 3): ";
     cin >> choice;
     cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Clear input buffer after reading choice
     
     if (choice == '1') {
         interactive_mining();
+    } else if (choice == '3') {
+        parallel_scaling_report();
     } else {
         demonstrate_subsequence_miner();
     }